@@ -0,0 +1,211 @@
+// Interpreter throughput benchmark.
+//
+// Runs each ROM headless in-process for a fixed number of instructions with
+// the original nibble-indexed dispatch tables, the 64K decode table, and the
+// decode table plus fused pairs, and reports nanoseconds per instruction
+// (best of several runs). It also estimates the data cache footprint of
+// decoding: the nested tables are always resident and take operands from
+// the opcode itself, while the decode table pulls in the 64 byte lines of
+// opcodes the ROM actually executes.
+// Build it once per HADRON8_BOUNDS policy to compare their cost.
+//
+// The same ROM also runs on the SUPER-CHIP and XO-CHIP cores (CHIP-8
+// programs are valid there), which shows what each variant's instantiation
+// costs over plain CHIP-8: bigger framebuffers, plane loops, the XO-CHIP
+// skip check and no fused pairs.
+//
+// Before timing anything it checks that every dispatch (nested or flat
+// decode, fusion off or on) leaves each ROM, and a program of undefined
+// opcodes the nibble-indexed tables used to alias, in the same state.
+// The exit status is 1 if any of them differ.
+//
+// Results go to stderr; stdout carries the machines' own output (BEEP!).
+//
+// Usage: bench_core [--instructions N] [--runs N] rom...
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+
+#include "../src/hadron8.h"
+
+static long long now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+enum Mode { nested, flat, flat_fused, schip, xochip };
+static const char* mode_names[] = { "nested", "flat", "flat+fused", "schip", "xochip" };
+
+// Same as the emulator's main loop, so games waiting on the delay timer
+// spin for as many instructions as they do there
+static const uint64_t cycles_per_frame = 10;
+
+// Frames each dispatch runs a ROM for before their states are compared
+static const uint64_t check_frames = 6000;
+
+// Undefined opcodes next to the instructions they share a nested table
+// slot with, each followed by code that changes the state if it ran as one
+static const uint8_t undefined_opcodes[] =
+{
+	0x60, 0x01, // V0 = 1
+	0xA0, 0x00, // I = font 0
+	0xD0, 0x15, // draw it
+	0x00, 0x00, // 0000 is not 00E0
+	0x50, 0x01, // 5001 is not 5000, which would skip
+	0x6A, 0x01,
+	0x90, 0x21, // 9021 is not 9020, which would skip
+	0x6B, 0x02,
+	0xA3, 0x00, // I = 0x300
+	0xF0, 0x03, // F003 is not F033
+	0xE0, 0x01, // E001 is not E0A1, which would skip
+	0x6C, 0x03,
+	0x80, 0x08, // 8008 is not an 8XYN
+	0x12, 0x1A  // loop
+};
+
+// Whether nested and flat decode, each with fusion off and on, end a
+// program (a ROM file, or program if rom is null) in the same state
+static bool dispatch_agrees(const char* rom, const uint8_t* program, size_t size)
+{
+	uint64_t first_hash = 0, first_invalid = 0;
+	for (int mode = 0; mode < 4; ++mode)
+	{
+		hadron8 h8(true);
+		if (rom != nullptr ? !h8.load_game(rom) : !h8.load_program(program, size))
+			return false;
+		h8.set_muted(true);
+		h8.set_flat_decode((mode & 1) != 0);
+		h8.set_fusion((mode & 2) != 0);
+		for (uint64_t frame = 0; frame < check_frames && h8.get_exit() == 0; ++frame)
+			h8.run_frame(cycles_per_frame);
+
+		if (mode == 0)
+		{
+			first_hash = h8.state_hash();
+			first_invalid = h8.get_invalid_opcodes();
+		}
+		else if (h8.state_hash() != first_hash || h8.get_invalid_opcodes() != first_invalid)
+			return false;
+	}
+	return true;
+}
+
+// Returns nanoseconds per instruction, or -1 if the ROM does not load
+template <class Machine>
+static double run_once(const char* rom, Mode mode, uint64_t instructions)
+{
+	Machine* h8 = new Machine(true);
+	if (!h8->load_game(rom))
+	{
+		delete h8;
+		return -1;
+	}
+	h8->set_flat_decode(mode != nested);
+	h8->set_fusion(mode == flat_fused);
+
+	long long start = now_ns();
+	for (uint64_t done = 0; done < instructions && h8->get_exit() == 0; done += cycles_per_frame)
+		h8->run_frame(std::min(cycles_per_frame, instructions - done));
+	long long elapsed = now_ns() - start;
+
+	double per_instruction = (double)elapsed / h8->get_cycles();
+	delete h8;
+	return per_instruction;
+}
+
+// Distinct 64 byte lines of the decode table this ROM's code touches
+static size_t decode_lines(const char* rom, uint64_t instructions)
+{
+	hadron8 h8(true);
+	if (!h8.load_game(rom))
+		return 0;
+	Coverage coverage;
+	h8.set_coverage(&coverage);
+	for (uint64_t done = 0; done < instructions && h8.get_exit() == 0; done += cycles_per_frame)
+		h8.run_frame(cycles_per_frame);
+
+	std::set<uintptr_t> lines;
+	const Rom& image = h8.get_rom();
+	for (int addr = 0; addr < 4095; ++addr)
+	{
+		if (!coverage.is_code(addr))
+			continue;
+		uint16_t op = image.page(addr >> Page::bits)->data[addr & Page::mask] << 8 |
+			image.page((addr + 1) >> Page::bits)->data[(addr + 1) & Page::mask];
+		lines.insert((uintptr_t)&decode_table.ops[op] / 64);
+	}
+	return lines.size();
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t instructions = 20000000;
+	int runs = 5;
+	int first_rom = argc;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--instructions") == 0 && i + 1 < argc)
+			instructions = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+			runs = atoi(argv[++i]);
+		else
+		{
+			first_rom = i;
+			break;
+		}
+	}
+
+	if (first_rom == argc || runs < 1 || instructions == 0)
+	{
+		fprintf(stderr, "Usage: bench_core [--instructions N] [--runs N] rom...\n");
+		return 1;
+	}
+
+	static const char* policies[] = { "unchecked", "wrap", "trap" };
+	fprintf(stderr, "bounds policy:  %s, machine %zu bytes (schip %zu, xochip %zu)\n", policies[HADRON8_BOUNDS],
+		sizeof(hadron8), sizeof(schip8), sizeof(xochip8));
+
+	// Every table the nested dispatch reads: opcodes[], five sub-tables and
+	// the 64 bytes of low bytes the 0, E and F groups check their slots against
+	const size_t member_pointer = sizeof(void (hadron8::*)());
+	fprintf(stderr, "nested tables:  %zu bytes\n", 6 * 16 * member_pointer + 64);
+	fprintf(stderr, "decode table:   %zu bytes, handlers %zu bytes\n\n", sizeof(decode_table), handler_count * member_pointer);
+
+	bool agree = dispatch_agrees(nullptr, undefined_opcodes, sizeof(undefined_opcodes));
+	fprintf(stderr, "undefined opcodes: %s\n\n", agree ? "same state in every dispatch" : "DISPATCH MISMATCH");
+
+	fprintf(stderr, "%-12s %12s %12s %12s %12s %12s %14s  %s\n", "rom", mode_names[nested], mode_names[flat], mode_names[flat_fused],
+		mode_names[schip], mode_names[xochip], "decode lines", "dispatch");
+	for (int i = first_rom; i < argc; ++i)
+	{
+		bool rom_agrees = dispatch_agrees(argv[i], nullptr, 0);
+		agree = agree && rom_agrees;
+
+		double best[5];
+		for (int mode = nested; mode <= xochip; ++mode)
+		{
+			best[mode] = -1;
+			for (int run = 0; run < runs; ++run)
+			{
+				double t = mode == schip ? run_once<schip8>(argv[i], flat, instructions) :
+					mode == xochip ? run_once<xochip8>(argv[i], flat, instructions) :
+					run_once<hadron8>(argv[i], (Mode)mode, instructions);
+				if (t >= 0 && (best[mode] < 0 || t < best[mode]))
+					best[mode] = t;
+			}
+		}
+
+		const char* name = strrchr(argv[i], '/');
+		name = name != nullptr ? name + 1 : argv[i];
+		size_t lines = decode_lines(argv[i], std::min<uint64_t>(instructions, 1000000));
+		fprintf(stderr, "%-12s %9.2f ns %9.2f ns %9.2f ns %9.2f ns %9.2f ns %6zu (%zu B)  %s\n", name, best[nested], best[flat],
+			best[flat_fused], best[schip], best[xochip], lines, lines * 64, rom_agrees ? "same" : "MISMATCH");
+	}
+
+	return agree ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+// Rollback netplay benchmark and loopback check.
+//
+// Runs two netplay hosts in one process, talking UDP over 127.0.0.1 through
+// the latency/loss shim, each with its own scripted player pressing keys
+// at 60 Hz. After the last frame both hosts settle, and their final state
+// is compared with a single machine that was fed both players' keys frame
+// by frame, with no network involved. The three must match exactly.
+//
+// Reports rollbacks, re-simulated frames, stalls and the time a host frame
+// takes, rollback included.
+//
+// Usage: bench_netplay [--frames N] [--delay MS] [--loss PCT] [--port P] rom
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "../src/hadron8.h"
+#include "../src/Netplay.h"
+#include "../src/FramePacer.h"
+
+// Same as the emulator's main loop
+static const int cycles_per_frame = 10;
+
+struct Host
+{
+	const char* rom;
+	uint16_t local_port;
+	uint16_t peer_port;
+	int player;
+	int frames;
+	int delay_ms;
+	double loss;
+
+	bool ok;
+	uint64_t hash;
+	uint64_t rollbacks;
+	uint64_t resimulated;
+	uint64_t stalls;
+	double avg_frame_us;
+	double max_frame_us;
+};
+
+// Scripted player: holds one of its two keys, or none, for 4-19 frames at a
+// time. Player 0 uses 1/4 and player 1 C/D, the paddles in PONG.
+static uint16_t script(int player, int64_t frame)
+{
+	static const int keys[2][2] = { { 0x1, 0x4 }, { 0xC, 0xD } };
+	int64_t start = 0;
+	uint32_t x = 0x9E3779B9u * (player + 1);
+	for (;;)
+	{
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		int64_t length = 4 + x % 16;
+		if (frame < start + length)
+			break;
+		start += length;
+	}
+	int choice = (x >> 8) % 3;
+	return choice == 2 ? 0 : 1 << keys[player][choice];
+}
+
+static void play(Host* host)
+{
+	host->ok = false;
+	hadron8 h8(true);
+	if (!h8.load_game(host->rom))
+		return;
+	h8.set_seed((uint32_t)h8.get_rom().get_hash());
+
+	Netplay<hadron8> netplay(cycles_per_frame);
+	if (!netplay.open(host->local_port, "127.0.0.1", host->peer_port))
+		return;
+	netplay.set_shim(host->delay_ms, host->loss);
+	if (!netplay.wait_for_peer(5000))
+		return;
+
+	FramePacer pacer(60.0);
+	double total_us = 0, max_us = 0;
+	int host_frames = 0;
+	while (netplay.get_frame() < host->frames && netplay.is_connected())
+	{
+		h8.set_keys(script(host->player, netplay.get_frame()));
+
+		auto start = std::chrono::steady_clock::now();
+		netplay.frame(h8);
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		total_us += us;
+		max_us = std::max(max_us, us);
+		++host_frames;
+
+		pacer.wait();
+	}
+
+	// Let the last keys arrive and any late rollback happen
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (!netplay.settle(h8) && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	// Keep answering so the peer can settle too
+	auto linger = std::chrono::steady_clock::now() + std::chrono::milliseconds(host->delay_ms * 4 + 200);
+	bool settled = false;
+	while (std::chrono::steady_clock::now() < linger)
+	{
+		settled = netplay.settle(h8);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	host->ok = settled && netplay.get_frame() == host->frames;
+	host->hash = h8.state_hash();
+	host->rollbacks = netplay.get_rollbacks();
+	host->resimulated = netplay.get_resimulated();
+	host->stalls = netplay.get_stalls();
+	host->avg_frame_us = host_frames == 0 ? 0 : total_us / host_frames;
+	host->max_frame_us = max_us;
+}
+
+int main(int argc, char** argv)
+{
+	int frames = 600;
+	int delay_ms = 50;
+	double loss = 0.05;
+	int port = 47800;
+	const char* rom = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--delay") == 0 && i + 1 < argc)
+			delay_ms = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--loss") == 0 && i + 1 < argc)
+			loss = atof(argv[++i]) / 100.0;
+		else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+			port = atoi(argv[++i]);
+		else
+			rom = argv[i];
+	}
+
+	if (rom == nullptr)
+	{
+		fprintf(stderr, "Usage: bench_netplay [--frames N] [--delay MS] [--loss PCT] [--port P] rom\n");
+		return 1;
+	}
+
+	Host hosts[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		hosts[i].rom = rom;
+		hosts[i].local_port = (uint16_t)(port + i);
+		hosts[i].peer_port = (uint16_t)(port + 1 - i);
+		hosts[i].player = i;
+		hosts[i].frames = frames;
+		hosts[i].delay_ms = delay_ms;
+		hosts[i].loss = loss;
+	}
+
+	std::thread first(play, &hosts[0]);
+	std::thread second(play, &hosts[1]);
+	first.join();
+	second.join();
+
+	// The same game on one machine with both players at its keyboard
+	hadron8 reference(true);
+	if (!reference.load_game(rom))
+		return 1;
+	reference.set_seed((uint32_t)reference.get_rom().get_hash());
+	reference.set_muted(true);
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		reference.set_keys(script(0, frame) | script(1, frame));
+		reference.run_frame(cycles_per_frame);
+	}
+	uint64_t expected = reference.state_hash();
+
+	fprintf(stderr, "%d frames, %d ms one-way delay, %.1f%% loss\n", frames, delay_ms, loss * 100);
+	fprintf(stderr, "%-6s %10s %12s %8s %12s %12s  %s\n", "host", "rollbacks", "resimulated", "stalls", "avg frame", "max frame", "state");
+	bool pass = true;
+	for (int i = 0; i < 2; ++i)
+	{
+		bool match = hosts[i].ok && hosts[i].hash == expected;
+		pass = pass && match;
+		fprintf(stderr, "%-6d %10llu %12llu %8llu %9.1f us %9.1f us  %s\n", i, (unsigned long long)hosts[i].rollbacks,
+			(unsigned long long)hosts[i].resimulated, (unsigned long long)hosts[i].stalls, hosts[i].avg_frame_us,
+			hosts[i].max_frame_us, match ? "matches reference" : hosts[i].ok ? "DESYNC" : "did not finish");
+	}
+	return pass ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+// Run-ahead benchmark: input-to-screen latency and its CPU cost.
+//
+// For each run-ahead depth, two headless machines with the same seed play
+// the ROM side by side; one of them gets a key pressed (and held) at a fixed
+// frame. The latency is the number of host frames from the press until the
+// presented screens differ, 0 meaning the frame the key was sampled in. The
+// cost is the wall time per host frame.
+//
+// Results go to stderr; stdout carries the machines' own output.
+//
+// Usage: bench_runahead [--key K] [--press-frame F] [--max-ahead N] rom
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../src/hadron8.h"
+#include "../src/RunAhead.h"
+
+// Same as the emulator's main loop
+static const int cycles_per_frame = 10;
+
+static const int search_frames = 600;
+static const int timed_frames = 20000;
+
+static long long now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool same_screen(const hadron8& a, const hadron8& b)
+{
+	for (int y = 0; y < 32; ++y)
+		for (int x = 0; x < 64; ++x)
+			if (a.get_pixel(x, y) != b.get_pixel(x, y))
+				return false;
+	return true;
+}
+
+// Frames from the press until the screen reacts, or -1 if it never does
+static int latency(const char* rom, int ahead, int key, int press_frame)
+{
+	hadron8 pressed(true), idle(true);
+	if (!pressed.load_game(rom) || !idle.load_game(rom))
+		return -1;
+	pressed.set_seed(1);
+	idle.set_seed(1);
+
+	RunAhead<hadron8> pressed_ahead(ahead, cycles_per_frame), idle_ahead(ahead, cycles_per_frame);
+	for (int frame = 0; frame < press_frame + search_frames; ++frame)
+	{
+		if (frame == press_frame)
+			pressed.set_key(key, 1);
+		const hadron8& a = pressed_ahead.frame(pressed);
+		const hadron8& b = idle_ahead.frame(idle);
+		if (frame >= press_frame && !same_screen(a, b))
+			return frame - press_frame;
+	}
+	return -1;
+}
+
+// Nanoseconds of emulation per host frame
+static double frame_cost(const char* rom, int ahead)
+{
+	hadron8 h8(true);
+	if (!h8.load_game(rom))
+		return -1;
+	h8.set_seed(1);
+
+	RunAhead<hadron8> run_ahead(ahead, cycles_per_frame);
+	long long start = now_ns();
+	for (int frame = 0; frame < timed_frames; ++frame)
+		run_ahead.frame(h8);
+	return (double)(now_ns() - start) / timed_frames;
+}
+
+int main(int argc, char** argv)
+{
+	int key = 0x4;
+	int press_frame = 120;
+	int max_ahead = 4;
+	const char* rom = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--key") == 0 && i + 1 < argc)
+			key = (int)strtol(argv[++i], nullptr, 16);
+		else if (strcmp(argv[i], "--press-frame") == 0 && i + 1 < argc)
+			press_frame = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--max-ahead") == 0 && i + 1 < argc)
+			max_ahead = atoi(argv[++i]);
+		else
+			rom = argv[i];
+	}
+
+	if (rom == nullptr)
+	{
+		fprintf(stderr, "Usage: bench_runahead [--key K] [--press-frame F] [--max-ahead N] rom\n");
+		return 1;
+	}
+
+	fprintf(stderr, "%-10s %16s %16s\n", "run-ahead", "latency", "cost per frame");
+	for (int ahead = 0; ahead <= max_ahead; ++ahead)
+	{
+		int frames = latency(rom, ahead, key, press_frame);
+		double cost = frame_cost(rom, ahead);
+		if (frames < 0)
+			fprintf(stderr, "%-10d %16s %13.2f us\n", ahead, "no reaction", cost / 1000);
+		else
+			fprintf(stderr, "%-10d %9d frames %13.2f us\n", ahead, frames, cost / 1000);
+	}
+
+	return 0;
+}
@@ -0,0 +1,187 @@
+// Startup latency benchmark: process start to first executed instruction.
+//
+// Spawns the emulator with --startup-probe in headless and windowed mode and
+// compares the spawn time with the first-instruction timestamp the child
+// prints. Both sides read CLOCK_MONOTONIC through std::chrono::steady_clock,
+// so the timestamps are comparable across processes. For comparison it then
+// starts the emulator as a daemon and times one-instruction jobs sent over
+// its socket, from request to reply. POSIX only.
+//
+// Usage: bench_startup path/to/hadron-chip8 path/to/rom [runs]
+
+#include <algorithm>
+#include <csignal>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+static long long now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Returns microseconds from spawn to first instruction, or -1 on failure
+static double run_once(const char* emu, const char* rom, bool headless)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+		return -1;
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addclose(&actions, fds[0]);
+
+	std::vector<char*> args;
+	args.push_back((char*)emu);
+	args.push_back((char*)"--startup-probe");
+	if (headless)
+		args.push_back((char*)"--headless");
+	args.push_back((char*)rom);
+	args.push_back(nullptr);
+
+	pid_t pid;
+	long long start = now_ns();
+	int err = posix_spawn(&pid, emu, &actions, nullptr, args.data(), environ);
+	posix_spawn_file_actions_destroy(&actions);
+	close(fds[1]);
+	if (err != 0)
+	{
+		close(fds[0]);
+		return -1;
+	}
+
+	char out[4096];
+	size_t len = 0;
+	ssize_t n;
+	while (len < sizeof(out) - 1 && (n = read(fds[0], out + len, sizeof(out) - 1 - len)) > 0)
+		len += n;
+	out[len] = 0;
+	close(fds[0]);
+	waitpid(pid, nullptr, 0);
+
+	const char* line = strstr(out, "first instruction at ");
+	if (line == nullptr)
+		return -1;
+	long long first = atoll(line + strlen("first instruction at "));
+	return (first - start) / 1000.0;
+}
+
+static void bench(const char* emu, const char* rom, bool headless, int runs)
+{
+	std::vector<double> samples;
+	for (int i = 0; i < runs; ++i)
+	{
+		double us = run_once(emu, rom, headless);
+		if (us >= 0)
+			samples.push_back(us);
+	}
+
+	if (samples.empty())
+	{
+		printf("%-9s failed\n", headless ? "headless" : "windowed");
+		return;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	printf("%-9s runs %3d  min %9.1f us  median %9.1f us  max %9.1f us\n",
+		headless ? "headless" : "windowed", (int)samples.size(),
+		samples.front(), samples[samples.size() / 2], samples.back());
+}
+
+// Sends one request line and reads the reply line into reply
+static bool request(int fd, const char* line, char* reply, size_t size)
+{
+	if (write(fd, line, strlen(line)) != (ssize_t)strlen(line))
+		return false;
+	size_t len = 0;
+	while (len < size - 1 && (len == 0 || reply[len - 1] != '\n'))
+	{
+		ssize_t n = read(fd, reply + len, 1);
+		if (n <= 0)
+			return false;
+		len += n;
+	}
+	reply[len] = 0;
+	return true;
+}
+
+static void bench_daemon(const char* emu, const char* rom, int runs)
+{
+	char socket_path[64];
+	snprintf(socket_path, sizeof(socket_path), "/tmp/bench_startup.%d.sock", (int)getpid());
+	const char* args[] = { emu, "--daemon", socket_path, "--workers", "1", nullptr };
+	pid_t pid;
+	if (posix_spawn(&pid, emu, nullptr, nullptr, (char**)args, environ) != 0)
+	{
+		printf("daemon    failed\n");
+		return;
+	}
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	bool connected = false;
+	for (int attempt = 0; attempt < 500 && !connected; ++attempt)
+	{
+		connected = connect(fd, (sockaddr*)&address, sizeof(address)) == 0;
+		if (!connected)
+			usleep(10000);
+	}
+
+	std::vector<double> samples;
+	char line[4200], reply[256], hash[32];
+	snprintf(line, sizeof(line), "load %s\n", rom);
+	if (connected && request(fd, line, reply, sizeof(reply)) && sscanf(reply, "%*s ok %31s", hash) == 1)
+	{
+		snprintf(line, sizeof(line), "run %s cycles 1\n", hash);
+		for (int i = 0; i < runs; ++i)
+		{
+			long long start = now_ns();
+			if (!request(fd, line, reply, sizeof(reply)) || strstr(reply, " ok ") == nullptr)
+				break;
+			samples.push_back((now_ns() - start) / 1000.0);
+		}
+		request(fd, "shutdown\n", reply, sizeof(reply));
+	}
+	else
+		kill(pid, SIGTERM);
+	close(fd);
+	waitpid(pid, nullptr, 0);
+
+	if (samples.empty())
+	{
+		printf("daemon    failed\n");
+		return;
+	}
+	std::sort(samples.begin(), samples.end());
+	printf("%-9s runs %3d  min %9.1f us  median %9.1f us  max %9.1f us\n", "daemon", (int)samples.size(),
+		samples.front(), samples[samples.size() / 2], samples.back());
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		printf("Usage: bench_startup path/to/hadron-chip8 path/to/rom [runs]\n");
+		return 1;
+	}
+	int runs = argc > 3 ? atoi(argv[3]) : 20;
+
+	bench(argv[1], argv[2], true, runs);
+	bench(argv[1], argv[2], false, runs);
+	bench_daemon(argv[1], argv[2], runs);
+	return 0;
+}
@@ -0,0 +1,450 @@
+#include "Analysis.h"
+#include "Disassembler.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const char* edge_names[] = { "", "jump", "skip", "call", "return", "table" };
+
+Analysis::Analysis(const uint8_t* source, size_t program_size)
+	: program_end(0x200 + program_size), states(size), successors(size), instruction_count(0)
+{
+	memcpy(image, source, size);
+	memset(memory_flags, 0, sizeof(memory_flags));
+	if (program_end > size)
+		program_end = size;
+
+	explore();
+	classify();
+	build_blocks();
+	assign_subroutines();
+}
+
+// Constant on entry to an instruction reached from two places
+static inline int merge_value(int a, int b)
+{
+	if (a == b)
+		return a;
+	return a == -2 /* unreached */ ? b : -1 /* unknown */;
+}
+
+/*
+	Worklist over instructions: each one is (re)visited until the constants
+	known on entry to it stop changing. A value only ever goes from not
+	reached to a constant to unknown, so this terminates.
+*/
+void Analysis::explore()
+{
+	if (!in_program(0x200))
+		return;
+
+	// A reset machine starts with I and every register at 0
+	states[0x200].I = 0;
+	states[0x200].V0 = 0;
+	std::vector<uint16_t> work(1, 0x200);
+
+	while (!work.empty())
+	{
+		uint16_t addr = work.back();
+		work.pop_back();
+
+		std::vector<Successor> next;
+		State out = execute(addr, states[addr], next);
+		successors[addr] = next;
+
+		for (const Successor& s : next)
+		{
+			if (!in_program(s.addr))
+				continue;
+			// A subroutine may have changed anything by the time it returns
+			State in = out;
+			if (s.kind == return_site)
+				in.I = in.V0 = unknown;
+
+			State& entry_state = states[s.addr];
+			State merged;
+			merged.I = merge_value(entry_state.I, in.I);
+			merged.V0 = merge_value(entry_state.V0, in.V0);
+			if (merged.I != entry_state.I || merged.V0 != entry_state.V0)
+			{
+				entry_state = merged;
+				work.push_back(s.addr);
+			}
+		}
+	}
+}
+
+/*
+	The successors of the instruction at addr, and the constants after it.
+*/
+Analysis::State Analysis::execute(uint16_t addr, State s, std::vector<Successor>& out)
+{
+	uint16_t op = opcode_at(addr);
+	unsigned x = (op & 0x0F00) >> 8;
+	unsigned nn = op & 0x00FF;
+	unsigned nnn = op & 0x0FFF;
+	if (!is_valid_opcode(op))
+		return s;
+
+	State next = s;
+	switch (op & 0xF000)
+	{
+	case 0x0000:
+		if (op == 0x00EE)
+			return s;
+		break;
+	case 0x1000:
+		out.push_back({ (uint16_t)nnn, jump });
+		return s;
+	case 0x2000:
+		out.push_back({ (uint16_t)nnn, call });
+		out.push_back({ (uint16_t)(addr + 2), return_site });
+		return s;
+	case 0x3000: case 0x4000: case 0x5000: case 0x9000: case 0xE000:
+		out.push_back({ (uint16_t)(addr + 2), fall_through });
+		out.push_back({ (uint16_t)(addr + 4), skip });
+		return s;
+	case 0x6000:
+		if (x == 0)
+			next.V0 = nn;
+		break;
+	case 0x7000:
+		if (x == 0)
+			next.V0 = s.V0 >= 0 ? (s.V0 + nn) & 0xFF : unknown;
+		break;
+	case 0x8000: case 0xC000:
+		if (x == 0)
+			next.V0 = unknown;
+		break;
+	case 0xA000:
+		next.I = nnn;
+		break;
+	case 0xB000:
+		if (s.V0 >= 0)
+			out.push_back({ (uint16_t)((nnn + s.V0) & 0xFFF), jump });
+		else
+		{
+			// V0 could be anything: guess a table of jumps at NNN, the
+			// usual way to dispatch on a value
+			for (unsigned entry = nnn; entry <= nnn + 0xFE && in_program(entry); entry += 2)
+			{
+				if ((opcode_at(entry) & 0xF000) != 0x1000)
+					break;
+				out.push_back({ (uint16_t)entry, table });
+			}
+		}
+		return s;
+	case 0xF000:
+		switch (nn)
+		{
+		case 0x07: case 0x0A:
+			if (x == 0)
+				next.V0 = unknown;
+			break;
+		case 0x1E:
+			next.I = x == 0 && s.I >= 0 && s.V0 >= 0 ? (s.I + s.V0) & 0xFFFF : unknown;
+			break;
+		case 0x29:
+			next.I = x == 0 && s.V0 >= 0 ? s.V0 * 5 : unknown;
+			break;
+		case 0x55:
+			next.I = s.I >= 0 ? (s.I + x + 1) & 0xFFFF : unknown;
+			break;
+		case 0x65:
+			next.I = s.I >= 0 ? (s.I + x + 1) & 0xFFFF : unknown;
+			next.V0 = unknown;
+			break;
+		}
+		break;
+	}
+
+	out.push_back({ (uint16_t)(addr + 2), fall_through });
+	return next;
+}
+
+void Analysis::mark(int addr, int length, uint8_t flag)
+{
+	for (int i = 0; i < length; ++i)
+		memory_flags[(addr + i) & (size - 1)] |= flag;
+}
+
+/*
+	With the constants settled, marks code, the data it reads and the
+	memory it writes, then checks the writes against the code.
+*/
+void Analysis::classify()
+{
+	for (int addr = 0; addr < size; ++addr)
+	{
+		if (states[addr].I == unreached)
+			continue;
+		mark(addr, 2, code);
+		memory_flags[addr] |= entry;
+		++instruction_count;
+
+		for (const Successor& s : successors[addr])
+			if (s.kind == table)
+				mark(s.addr, 2, jump_table);
+	}
+
+	std::vector<Write> writes;
+	for (int addr = 0; addr < size; ++addr)
+	{
+		if (states[addr].I == unreached)
+			continue;
+		uint16_t op = opcode_at(addr);
+		unsigned x = (op & 0x0F00) >> 8;
+		int I = states[addr].I;
+
+		if ((op & 0xF000) == 0xD000 && I >= 0)
+			mark(I, op & 0x000F, data);
+		else if ((op & 0xF0FF) == 0xF065 && I >= 0)
+			mark(I, x + 1, data);
+		else if ((op & 0xF0FF) == 0xF055)
+			writes.push_back({ (uint16_t)addr, I, (uint8_t)(x + 1) });
+		else if ((op & 0xF0FF) == 0xF033)
+			writes.push_back({ (uint16_t)addr, I, 3 });
+		else if ((op & 0xF000) == 0xB000 && states[addr].V0 < 0)
+			unresolved_jumps.push_back((uint16_t)addr);
+	}
+
+	for (const Write& w : writes)
+	{
+		if (w.target < 0)
+		{
+			code_writes.push_back(w);
+			continue;
+		}
+		mark(w.target, w.length, written);
+		for (int i = 0; i < w.length; ++i)
+		{
+			if (is_code((uint16_t)(w.target + i)))
+			{
+				code_writes.push_back(w);
+				break;
+			}
+		}
+	}
+}
+
+/*
+	A block starts at 0x200, at any target of a jump, skip, call or table,
+	and wherever more than one instruction leads; it runs until an
+	instruction that does not simply fall through to the next one.
+*/
+void Analysis::build_blocks()
+{
+	std::vector<int> predecessors(size, 0);
+	std::vector<bool> plain(size, false); // Reached by a lone fall-through
+	for (int addr = 0; addr < size; ++addr)
+	{
+		if ((memory_flags[addr] & entry) == 0)
+			continue;
+		for (const Successor& s : successors[addr])
+		{
+			if (!in_program(s.addr))
+				continue;
+			++predecessors[s.addr];
+			if (s.kind == fall_through && successors[addr].size() == 1)
+				plain[s.addr] = true;
+		}
+	}
+
+	std::vector<bool> leader(size, false);
+	for (int addr = 0; addr < size; ++addr)
+		if ((memory_flags[addr] & entry) != 0)
+			leader[addr] = addr == 0x200 || predecessors[addr] != 1 || !plain[addr];
+
+	for (int addr = 0; addr < size; ++addr)
+	{
+		if (!leader[addr])
+			continue;
+		int last = addr;
+		while (successors[last].size() == 1 && successors[last][0].kind == fall_through && last + 2 < size &&
+			(memory_flags[last + 2] & entry) != 0 && !leader[last + 2])
+			last += 2;
+
+		Block block;
+		block.start = (uint16_t)addr;
+		block.end = (uint16_t)(last + 2);
+		block.subroutine = 0x200;
+		block.successors = successors[last];
+		blocks.push_back(block);
+	}
+}
+
+int Analysis::block_at(uint16_t addr) const
+{
+	auto it = std::lower_bound(blocks.begin(), blocks.end(), addr,
+		[](const Block& b, uint16_t a) { return b.start < a; });
+	if (it == blocks.end() || it->start != addr)
+		return -1;
+	return (int)(it - blocks.begin());
+}
+
+/*
+	Subroutines are 0x200 and every call target. Each one owns the blocks
+	it reaches without following calls; a block reachable from several
+	belongs to the first.
+*/
+void Analysis::assign_subroutines()
+{
+	subroutines.push_back(0x200);
+	for (const Block& block : blocks)
+		for (const Successor& s : block.successors)
+			if (s.kind == call && block_at(s.addr) >= 0)
+				subroutines.push_back(s.addr);
+	std::sort(subroutines.begin() + 1, subroutines.end());
+	subroutines.erase(std::unique(subroutines.begin(), subroutines.end()), subroutines.end());
+
+	std::vector<bool> assigned(blocks.size(), false);
+	for (uint16_t entry_addr : subroutines)
+	{
+		std::vector<int> work;
+		int first = block_at(entry_addr);
+		if (first >= 0 && !assigned[first])
+			work.push_back(first);
+		while (!work.empty())
+		{
+			int b = work.back();
+			work.pop_back();
+			if (assigned[b])
+				continue;
+			assigned[b] = true;
+			blocks[b].subroutine = entry_addr;
+			for (const Successor& s : blocks[b].successors)
+			{
+				int next = s.kind == call ? -1 : block_at(s.addr);
+				if (next >= 0 && !assigned[next])
+					work.push_back(next);
+			}
+		}
+	}
+}
+
+/*
+	Instructions whose opcode and the next one's top nibble lie in one page,
+	so a machine can trust the entry while that page is still the ROM's.
+*/
+std::vector<PredecodedOp> Analysis::predecode() const
+{
+	std::vector<PredecodedOp> ops(size);
+	for (int addr = 0; addr < size; ++addr)
+	{
+		if ((memory_flags[addr] & entry) == 0 || (addr & Page::mask) > Page::mask - 2)
+			continue;
+		ops[addr].opcode = opcode_at(addr);
+		ops[addr].next = image[addr + 2] >> 4;
+		ops[addr].valid = 1;
+	}
+	return ops;
+}
+
+void Analysis::write_text(FILE* out) const
+{
+	int data_bytes = 0, unreached_bytes = 0;
+	for (int addr = 0x200; addr < (int)program_end; ++addr)
+	{
+		data_bytes += (memory_flags[addr] & data) != 0;
+		unreached_bytes += (memory_flags[addr] & (code | data)) == 0;
+	}
+
+	fprintf(out, "; %d instructions in %zu blocks, %zu subroutines\n", instruction_count, blocks.size(), subroutines.size());
+	fprintf(out, "; %d bytes of data, %d bytes neither reached nor read\n", data_bytes, unreached_bytes);
+	for (uint16_t addr : unresolved_jumps)
+		fprintf(out, "; 0x%03X: BNNN with unknown V0, targets guessed\n", addr);
+	for (const Write& w : code_writes)
+	{
+		if (w.target < 0)
+			fprintf(out, "; 0x%03X: possible self-modifying write, I unknown\n", w.at);
+		else
+			fprintf(out, "; 0x%03X: self-modifying write to 0x%03X-0x%03X\n", w.at, w.target, w.target + w.length - 1);
+	}
+
+	for (uint16_t sub : subroutines)
+	{
+		fprintf(out, "\nsub_%03X:\n", sub);
+		for (const Block& block : blocks)
+		{
+			if (block.subroutine != sub)
+				continue;
+			fprintf(out, "L_%03X:\n", block.start);
+			for (int addr = block.start; addr < block.end; addr += 2)
+			{
+				char text[32];
+				uint16_t op = opcode_at(addr);
+				disassemble(op, text, sizeof(text));
+				if (is_valid_opcode(op))
+					fprintf(out, "\t%03X  %04X  %s\n", addr, op, text);
+				else
+					fprintf(out, "\t%03X  %04X  %-20s; undefined, stops here\n", addr, op, text);
+			}
+			bool first = true;
+			for (const Successor& s : block.successors)
+			{
+				if (s.kind == fall_through && s.addr == block.end)
+					continue;
+				fprintf(out, "%s L_%03X%s%s", first ? "\t->" : ",", s.addr, s.kind == fall_through ? "" : " ", edge_names[s.kind]);
+				first = false;
+			}
+			if (!first)
+				fprintf(out, "\n");
+		}
+	}
+
+	// Data ranges as bit patterns, which makes sprites recognisable
+	fprintf(out, "\n; data\n");
+	for (int addr = 0; addr < size; ++addr)
+	{
+		if ((memory_flags[addr] & data) == 0)
+			continue;
+		if (addr == 0 || (memory_flags[addr - 1] & data) == 0)
+			fprintf(out, "D_%03X:\n", addr);
+		char bits[9];
+		for (int b = 0; b < 8; ++b)
+			bits[b] = (image[addr] >> (7 - b)) & 1 ? '#' : '.';
+		bits[8] = 0;
+		fprintf(out, "\t%03X  %02X    %s%s\n", addr, image[addr], bits, is_code(addr) ? "  ; also code" : "");
+	}
+}
+
+void Analysis::write_dot(FILE* out, const char* name) const
+{
+	fprintf(out, "digraph \"%s\" {\n", name);
+	fprintf(out, "\tnode [shape=box, fontname=\"monospace\"];\n");
+
+	for (uint16_t sub : subroutines)
+	{
+		fprintf(out, "\tsubgraph cluster_%03X {\n\t\tlabel=\"sub_%03X\";\n", sub, sub);
+		for (const Block& block : blocks)
+		{
+			if (block.subroutine != sub)
+				continue;
+			fprintf(out, "\t\tL_%03X [label=\"", block.start);
+			for (int addr = block.start; addr < block.end; addr += 2)
+			{
+				char text[32];
+				disassemble(opcode_at(addr), text, sizeof(text));
+				fprintf(out, "%03X  %s\\l", addr, text);
+			}
+			fprintf(out, "\"];\n");
+		}
+		fprintf(out, "\t}\n");
+	}
+
+	static const char* styles[] = { "solid", "solid", "solid", "dashed", "dotted", "bold" };
+	for (const Block& block : blocks)
+	{
+		for (const Successor& s : block.successors)
+		{
+			if (block_at(s.addr) < 0)
+			{
+				fprintf(out, "\tX_%03X [label=\"0x%03X\", shape=plaintext];\n", s.addr, s.addr);
+				fprintf(out, "\tL_%03X -> X_%03X [style=%s];\n", block.start, s.addr, styles[s.kind]);
+				continue;
+			}
+			fprintf(out, "\tL_%03X -> L_%03X [style=%s, label=\"%s\"];\n", block.start, s.addr, styles[s.kind], edge_names[s.kind]);
+		}
+	}
+	fprintf(out, "}\n");
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+#include "Memory.h"
+
+// Static analysis of a CHIP-8 program, without running it. Disassembles
+// recursively from 0x200, following jumps, calls, skips and BNNN jump
+// tables, and splits what it reached into basic blocks and subroutines.
+// Along the way it tracks I and V0 where they are constants, which tells
+// sprite data (read by DXYN and FX65) apart from code, resolves BNNN
+// when V0 is known and finds writes (FX55, FX33) that may modify code.
+//
+// Used by tools/hadron8-analyze, and by the core to pre-decode a ROM's
+// reachable instructions when it is loaded.
+
+class Analysis
+{
+public:
+	static const int size = 4096;
+
+	// What a byte of memory was found to be, as bits
+	enum
+	{
+		code = 1,       // Part of a reachable instruction
+		entry = 2,      // First byte of a reachable instruction
+		data = 4,       // Read as sprite or register data
+		jump_table = 8, // Entry of a table a BNNN jumps into
+		written = 16    // Written by FX55 or FX33
+	};
+
+	enum Edge { fall_through, jump, skip, call, return_site, table };
+
+	struct Successor
+	{
+		uint16_t addr;
+		Edge kind;
+	};
+
+	// Instructions from start up to end (exclusive) that always run together
+	struct Block
+	{
+		uint16_t start;
+		uint16_t end;
+		uint16_t subroutine; // Entry of the subroutine it belongs to
+		std::vector<Successor> successors;
+	};
+
+	// A write whose target is code, or could not be worked out
+	struct Write
+	{
+		uint16_t at;     // Address of the writing instruction
+		int target;      // First address written, -1 if I is unknown there
+		uint8_t length;
+	};
+
+	// image is 4 KB of memory with the program at 0x200
+	Analysis(const uint8_t* image, size_t program_size);
+
+	inline uint8_t flags(uint16_t addr) const { return memory_flags[addr & (size - 1)]; }
+	inline bool is_code(uint16_t addr) const { return (flags(addr) & code) != 0; }
+	inline bool is_data(uint16_t addr) const { return (flags(addr) & data) != 0; }
+
+	inline const std::vector<Block>& get_blocks() const { return blocks; }
+	inline const std::vector<uint16_t>& get_subroutines() const { return subroutines; }
+	inline const std::vector<Write>& get_code_writes() const { return code_writes; }
+	// BNNN instructions whose targets are guesses or unknown
+	inline const std::vector<uint16_t>& get_unresolved_jumps() const { return unresolved_jumps; }
+	inline int get_instruction_count() const { return instruction_count; }
+
+	// Every reachable instruction, for the core to skip fetching it
+	std::vector<PredecodedOp> predecode() const;
+
+	// Annotated listing: blocks with their successors, data ranges and warnings
+	void write_text(FILE* out) const;
+	// Control-flow graph in Graphviz dot, one cluster per subroutine
+	void write_dot(FILE* out, const char* name) const;
+private:
+	// Constant I and V0 on entry to an instruction: unknown, not reached
+	// yet, or their value
+	static const int unknown = -1;
+	static const int unreached = -2;
+	struct State
+	{
+		int I = unreached;
+		int V0 = unreached;
+	};
+
+	uint8_t image[size];
+	size_t program_end;
+
+	uint8_t memory_flags[size];
+	std::vector<State> states;
+	std::vector<std::vector<Successor>> successors; // Per instruction
+
+	std::vector<Block> blocks;
+	std::vector<uint16_t> subroutines;
+	std::vector<Write> code_writes;
+	std::vector<uint16_t> unresolved_jumps;
+	int instruction_count;
+
+	inline uint16_t opcode_at(int addr) const { return image[addr] << 8 | image[(addr + 1) & (size - 1)]; }
+	inline bool in_program(int addr) const { return addr >= 0x200 && addr + 1 < (int)program_end; }
+
+	void explore();
+	State execute(uint16_t addr, State state, std::vector<Successor>& out);
+	void mark(int addr, int length, uint8_t flag);
+	void build_blocks();
+	void assign_subroutines();
+	void classify();
+	int block_at(uint16_t addr) const;
+};
@@ -0,0 +1,175 @@
+#include "Coverage.h"
+#include "Disassembler.h"
+
+#include <cstdio>
+#include <cstring>
+
+struct CoverageHeader
+{
+	char magic[4]; // "H8CV"
+	uint16_t version;
+	uint16_t size;
+};
+
+Coverage::Coverage()
+{
+	memset(code, 0, sizeof(code));
+	memset(reads, 0, sizeof(reads));
+	memset(writes, 0, sizeof(writes));
+	memset(exec_count, 0, sizeof(exec_count));
+	memset(access_count, 0, sizeof(access_count));
+}
+
+static inline uint32_t add_saturated(uint32_t a, uint32_t b)
+{
+	return a > UINT32_MAX - b ? UINT32_MAX : a + b;
+}
+
+void Coverage::merge(const Coverage& other)
+{
+	for (int i = 0; i < size / 64; ++i)
+	{
+		code[i] |= other.code[i];
+		reads[i] |= other.reads[i];
+		writes[i] |= other.writes[i];
+	}
+	for (int i = 0; i < size; ++i)
+	{
+		exec_count[i] = add_saturated(exec_count[i], other.exec_count[i]);
+		access_count[i] = add_saturated(access_count[i], other.access_count[i]);
+	}
+}
+
+bool Coverage::load(const char* filename)
+{
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL)
+		return false;
+
+	CoverageHeader header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "H8CV", 4) == 0 &&
+		header.version == 1 && header.size == size &&
+		fread(code, sizeof(code), 1, file) == 1 &&
+		fread(reads, sizeof(reads), 1, file) == 1 &&
+		fread(writes, sizeof(writes), 1, file) == 1 &&
+		fread(exec_count, sizeof(exec_count), 1, file) == 1 &&
+		fread(access_count, sizeof(access_count), 1, file) == 1;
+	fclose(file);
+
+	if (!ok)
+		fprintf(stderr, "Coverage error: %s is not a hadron8 coverage file\n", filename);
+	return ok;
+}
+
+bool Coverage::save(const char* filename) const
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Coverage error: cannot write %s\n", filename);
+		return false;
+	}
+
+	CoverageHeader header = { { 'H', '8', 'C', 'V' }, 1, size };
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(code, sizeof(code), 1, file);
+	fwrite(reads, sizeof(reads), 1, file);
+	fwrite(writes, sizeof(writes), 1, file);
+	fwrite(exec_count, sizeof(exec_count), 1, file);
+	fwrite(access_count, sizeof(access_count), 1, file);
+	fclose(file);
+	return true;
+}
+
+/*
+	Listing layout, one line per instruction or data byte:
+
+	ADDR  WORD  MNEMONIC          FLAGS  EXECUTED  ACCESSED
+	200   6A02  LD VA, 0x02       X--         123         0
+	2EA   80    DB 0x80           -R-           0        57
+
+	X = executed as code, R = read as data, W = written
+*/
+bool Coverage::export_listing(const uint8_t* image, size_t program_size, const char* name,
+	const char* listing_filename, const char* lcov_filename) const
+{
+	FILE* listing = fopen(listing_filename, "w");
+	if (listing == NULL)
+	{
+		fprintf(stderr, "Coverage error: cannot write %s\n", listing_filename);
+		return false;
+	}
+	FILE* lcov = NULL;
+	if (lcov_filename != NULL)
+	{
+		lcov = fopen(lcov_filename, "w");
+		if (lcov == NULL)
+		{
+			fprintf(stderr, "Coverage error: cannot write %s\n", lcov_filename);
+			fclose(listing);
+			return false;
+		}
+		fprintf(lcov, "TN:\nSF:%s\n", listing_filename);
+	}
+
+	int line = 0;
+	int lines_found = 0, lines_hit = 0;
+	char text[32];
+
+	fprintf(listing, "; %s\n", name); ++line;
+	fprintf(listing, "; ADDR  WORD  MNEMONIC          FLAGS  EXECUTED  ACCESSED\n"); ++line;
+
+	// Font and interpreter area, only where the program touched it
+	for (int addr = 0; addr < 0x200; ++addr)
+	{
+		if (!is_read(addr) && !is_written(addr))
+			continue;
+		fprintf(listing, "  %03X   %02X    DB 0x%02X           -%c%c    %10u %9u\n", addr, image[addr], image[addr],
+			is_read(addr) ? 'R' : '-', is_written(addr) ? 'W' : '-', 0u, access_count[addr]);
+		++line;
+	}
+
+	int end = 0x200 + (int)program_size;
+	if (end > size)
+		end = size;
+
+	for (int addr = 0x200; addr < end; )
+	{
+		++line;
+		bool executed = exec_count[addr] != 0;
+		bool data = is_read(addr) || is_written(addr) || (is_code(addr) && !executed);
+
+		// Anything not known to be data is listed as an instruction, so code
+		// that never ran shows up as unhit lines. A byte is listed on its
+		// own when the next one starts an executed instruction.
+		if (executed || (!data && addr + 1 < end && exec_count[addr + 1] == 0))
+		{
+			// An instruction at the last byte takes its low byte from 0x000, as the core fetches it
+			uint16_t opcode = image[addr] << 8 | image[(addr + 1) & (size - 1)];
+			disassemble(opcode, text, sizeof(text));
+			fprintf(listing, "  %03X   %04X  %-17s %c%c%c    %10u %9u\n", addr, opcode, text, executed ? 'X' : '-',
+				is_read(addr) ? 'R' : '-', is_written(addr) ? 'W' : '-', exec_count[addr], access_count[addr]);
+			if (lcov != NULL)
+				fprintf(lcov, "DA:%d,%u\n", line, exec_count[addr]);
+			++lines_found;
+			if (executed)
+				++lines_hit;
+			addr += 2;
+		}
+		else
+		{
+			fprintf(listing, "  %03X   %02X    DB 0x%02X           -%c%c    %10u %9u\n", addr, image[addr], image[addr],
+				is_read(addr) ? 'R' : '-', is_written(addr) ? 'W' : '-', 0u, access_count[addr]);
+			addr += 1;
+		}
+	}
+
+	fclose(listing);
+
+	if (lcov != NULL)
+	{
+		fprintf(lcov, "LF:%d\nLH:%d\nend_of_record\n", lines_found, lines_hit);
+		fclose(lcov);
+	}
+	return true;
+}
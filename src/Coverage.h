@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Per-address record of how a ROM used memory: which bytes were executed
+// as code, read as data (sprites, FX65) and written (FX55, FX33), plus
+// execution and data access counts. Collections from many runs can be
+// saved, merged and exported as an annotated listing and lcov data.
+
+class Coverage
+{
+public:
+	static const int size = 4096;
+
+	Coverage();
+
+	inline void executed(uint16_t addr)
+	{
+		addr &= size - 1;
+		set(code, addr);
+		set(code, (addr + 1) & (size - 1));
+		if (exec_count[addr] != UINT32_MAX)
+			++exec_count[addr];
+	}
+	inline void read(uint16_t addr, int length) { access(reads, addr, length); }
+	inline void written(uint16_t addr, int length) { access(writes, addr, length); }
+
+	void merge(const Coverage&);
+	bool load(const char*);
+	bool save(const char*) const;
+
+	// Writes a listing of the program at 0x200 in image (a 4 KB memory
+	// image) and lcov data whose line numbers refer to that listing
+	bool export_listing(const uint8_t* image, size_t program_size, const char* name,
+		const char* listing_filename, const char* lcov_filename) const;
+
+	inline bool is_code(uint16_t addr) const { return test(code, addr); }
+	inline bool is_read(uint16_t addr) const { return test(reads, addr); }
+	inline bool is_written(uint16_t addr) const { return test(writes, addr); }
+	inline uint32_t get_exec_count(uint16_t addr) const { return exec_count[addr & (size - 1)]; }
+	inline uint32_t get_access_count(uint16_t addr) const { return access_count[addr & (size - 1)]; }
+private:
+	uint64_t code[size / 64];
+	uint64_t reads[size / 64];
+	uint64_t writes[size / 64];
+	uint32_t exec_count[size];
+	uint32_t access_count[size];
+
+	static inline void set(uint64_t* bits, uint16_t addr) { bits[addr >> 6] |= 1ull << (addr & 63); }
+	static inline bool test(const uint64_t* bits, uint16_t addr) { return (bits[(addr & (size - 1)) >> 6] >> (addr & 63)) & 1; }
+
+	inline void access(uint64_t* bits, uint16_t addr, int length)
+	{
+		for (int i = 0; i < length; ++i)
+		{
+			uint16_t a = (addr + i) & (size - 1);
+			set(bits, a);
+			if (access_count[a] != UINT32_MAX)
+				++access_count[a];
+		}
+	}
+};
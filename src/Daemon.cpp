@@ -0,0 +1,557 @@
+#include "Daemon.h"
+#include "hadron8.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Longest request line accepted; longer ones close the connection
+static const size_t max_line = 64 * 1024;
+// Most reply bytes kept for a client that is not reading; past it the
+// connection is dropped
+static const size_t max_backlog = 16 * 1024 * 1024;
+
+static void set_nonblocking(int fd)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+template <class Machine>
+Daemon<Machine>::Connection::~Connection()
+{
+	close(fd);
+}
+
+/*
+	Queues one reply line and sends what the socket takes now. Workers
+	finishing jobs of the same connection take turns so lines never
+	interleave; a client that went away is ignored.
+*/
+template <class Machine>
+void Daemon<Machine>::Connection::reply(const std::string& line)
+{
+	std::lock_guard<std::mutex> lock(write_lock);
+	if (broken)
+		return;
+	output += line;
+	output += '\n';
+	send();
+	if (output.size() > max_backlog)
+	{
+		broken = true;
+		output.clear();
+		shutdown(fd, SHUT_RDWR);
+	}
+}
+
+/*
+	Writes queued output until the socket would block. Call with write_lock held.
+*/
+template <class Machine>
+void Daemon<Machine>::Connection::send()
+{
+	size_t sent = 0;
+	while (sent < output.size())
+	{
+		ssize_t n = write(fd, output.data() + sent, output.size() - sent);
+		if (n > 0)
+			sent += n;
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		else
+		{
+			broken = true;
+			sent = output.size();
+		}
+	}
+	output.erase(0, sent);
+}
+
+template <class Machine>
+bool Daemon<Machine>::Connection::has_output()
+{
+	std::lock_guard<std::mutex> lock(write_lock);
+	return !output.empty();
+}
+
+template <class Machine>
+bool Daemon<Machine>::Connection::is_done()
+{
+	return !reading && jobs == 0 && !has_output();
+}
+
+template <class Machine>
+Daemon<Machine>::Daemon(int worker_count, int cycles_per_frame)
+	: cycles_per_frame(cycles_per_frame), listener(-1), wake{ -1, -1 }, stopping(false), shutdown_requested(false), jobs_done(0)
+{
+	for (int i = 0; i < worker_count; ++i)
+		workers.push_back(std::thread(&Daemon::work, this));
+}
+
+template <class Machine>
+Daemon<Machine>::~Daemon()
+{
+	{
+		std::lock_guard<std::mutex> lock(queue_lock);
+		stopping = true;
+	}
+	queue_ready.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+
+	if (listener >= 0)
+	{
+		close(listener);
+		unlink(socket_path.c_str());
+	}
+	if (wake[0] >= 0)
+	{
+		close(wake[0]);
+		close(wake[1]);
+	}
+}
+
+template <class Machine>
+bool Daemon<Machine>::open(const char* path)
+{
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path))
+	{
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		return false;
+	}
+	strcpy(address.sun_path, path);
+
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+	{
+		perror("socket");
+		return false;
+	}
+	unlink(path);
+	if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0)
+	{
+		fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+		close(listener);
+		listener = -1;
+		return false;
+	}
+	socket_path = path;
+
+	if (pipe(wake) != 0)
+	{
+		perror("pipe");
+		return false;
+	}
+	set_nonblocking(wake[0]);
+	set_nonblocking(wake[1]);
+
+	// Replies to clients that hung up must not kill the daemon
+	signal(SIGPIPE, SIG_IGN);
+	return true;
+}
+
+/*
+	One thread polls the listener, every connection and the wake pipe. A
+	connection stays after its client stops sending (EOF, quit) until its
+	jobs have replied and the replies are sent. After shutdown nothing more
+	is read, and serve() returns once every connection is done.
+*/
+template <class Machine>
+void Daemon<Machine>::serve()
+{
+	std::vector<std::shared_ptr<Connection>> connections;
+	std::vector<pollfd> fds;
+
+	while (!shutdown_requested || !connections.empty())
+	{
+		fds.clear();
+		fds.push_back({ wake[0], POLLIN, 0 });
+		fds.push_back({ listener, (short)(shutdown_requested ? 0 : POLLIN), 0 });
+		for (const std::shared_ptr<Connection>& connection : connections)
+		{
+			// A connection waiting only for its jobs is left out (fd -1), or
+			// a hangup would wake the loop over and over
+			short events = (connection->reading ? POLLIN : 0) | (connection->has_output() ? POLLOUT : 0);
+			fds.push_back({ events != 0 ? connection->fd : -1, events, 0 });
+		}
+
+		if (poll(fds.data(), fds.size(), -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
+
+		if (fds[0].revents & POLLIN)
+		{
+			char drain[64];
+			while (read(wake[0], drain, sizeof(drain)) > 0)
+			{
+			}
+		}
+
+		if (fds[1].revents & POLLIN)
+		{
+			int fd = accept(listener, nullptr, nullptr);
+			if (fd >= 0)
+			{
+				set_nonblocking(fd);
+				connections.push_back(std::make_shared<Connection>(fd));
+			}
+		}
+
+		for (size_t i = 2; i < fds.size(); ++i)
+		{
+			const std::shared_ptr<Connection>& connection = connections[i - 2];
+			if (fds[i].revents & POLLOUT)
+			{
+				std::lock_guard<std::mutex> lock(connection->write_lock);
+				connection->send();
+			}
+			if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) == 0 || !connection->reading)
+				continue;
+
+			char buffer[4096];
+			ssize_t n = read(connection->fd, buffer, sizeof(buffer));
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+				continue;
+			bool open = n > 0;
+			if (open)
+			{
+				connection->input.append(buffer, n);
+				size_t start = 0, end;
+				while (open && (end = connection->input.find('\n', start)) != std::string::npos)
+				{
+					connection->input[end] = 0;
+					open = handle(connection, &connection->input[start]);
+					start = end + 1;
+				}
+				connection->input.erase(0, start);
+				if (connection->input.size() > max_line)
+					open = false;
+			}
+			if (!open)
+				connection->reading = false;
+		}
+
+		if (shutdown_requested)
+			for (const std::shared_ptr<Connection>& connection : connections)
+				connection->reading = false;
+
+		// Queued jobs keep a dropped connection alive until they have replied
+		size_t kept = 0;
+		for (size_t i = 0; i < connections.size(); ++i)
+			if (!connections[i]->is_done())
+				connections[kept++] = connections[i];
+		connections.resize(kept);
+	}
+}
+
+/*
+	Handles one request line. Returns false when the connection should be
+	closed.
+*/
+template <class Machine>
+bool Daemon<Machine>::handle(const std::shared_ptr<Connection>& connection, char* line)
+{
+	size_t length = strlen(line);
+	if (length > 0 && line[length - 1] == '\r')
+		line[length - 1] = 0;
+
+	char* rest;
+	char* command = strtok_r(line, " \t", &rest);
+	if (command == nullptr)
+		return true;
+	char* args = strtok_r(nullptr, "", &rest);
+
+	uint64_t request = connection->requests++;
+	char number[32];
+	snprintf(number, sizeof(number), "%llu ", (unsigned long long)request);
+	std::string prefix = number;
+
+	if (strcmp(command, "run") == 0)
+	{
+		Job job;
+		std::string error;
+		job.connection = connection;
+		job.request = request;
+		if (!parse_run(job, args, error))
+		{
+			connection->reply(prefix + error);
+			return true;
+		}
+		++connection->jobs;
+		{
+			std::lock_guard<std::mutex> lock(queue_lock);
+			queue.push_back(std::move(job));
+		}
+		queue_ready.notify_one();
+	}
+	else if (strcmp(command, "load") == 0 && args != nullptr)
+		connection->reply(prefix + load(args));
+	else if (strcmp(command, "stats") == 0)
+	{
+		char stats[128];
+		{
+			std::lock_guard<std::mutex> lock(queue_lock);
+			snprintf(stats, sizeof(stats), "ok roms %zu workers %zu jobs %llu queued %zu",
+				roms.size(), workers.size(), (unsigned long long)jobs_done, queue.size());
+		}
+		connection->reply(prefix + stats);
+	}
+	else if (strcmp(command, "quit") == 0)
+		return false;
+	else if (strcmp(command, "shutdown") == 0)
+	{
+		connection->reply(prefix + "ok");
+		shutdown_requested = true;
+	}
+	else
+		connection->reply(prefix + "error unknown request " + command);
+	return true;
+}
+
+/*
+	Loads and boots the ROM at path unless a ROM with the same program is
+	cached already, and returns the reply naming its hash.
+*/
+template <class Machine>
+std::string Daemon<Machine>::load(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+		return std::string("error cannot open ") + path;
+	std::vector<uint8_t> program;
+	uint8_t buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		program.insert(program.end(), buffer, buffer + n);
+	fclose(file);
+
+	uint64_t hash = rom_hash(program.data(), program.size());
+	if (roms.find(hash) == roms.end())
+	{
+		std::unique_ptr<Machine> booted(new Machine(true));
+		booted->set_muted(true);
+		if (!booted->load_program(program.data(), program.size()))
+			return std::string("error ROM too big: ") + path;
+		roms[hash] = std::move(booted);
+	}
+
+	char reply[32];
+	snprintf(reply, sizeof(reply), "ok %016llx", (unsigned long long)hash);
+	return reply;
+}
+
+template <class Machine>
+bool Daemon<Machine>::parse_run(Job& job, char* args, std::string& error)
+{
+	char* rest;
+	char* hash = args != nullptr ? strtok_r(args, " \t", &rest) : nullptr;
+	if (hash == nullptr)
+	{
+		error = "error run needs a ROM hash";
+		return false;
+	}
+	auto found = roms.find(strtoull(hash, nullptr, 16));
+	if (found == roms.end())
+	{
+		error = std::string("error unknown ROM ") + hash + ", load it first";
+		return false;
+	}
+	job.rom = found->second.get();
+
+	job.frames = 0;
+	job.cycles = 0;
+	job.seed = 1;
+	job.capture = false;
+	while (char* word = strtok_r(nullptr, " \t", &rest))
+	{
+		if (strcmp(word, "capture") == 0)
+		{
+			job.capture = true;
+			continue;
+		}
+		char* value = strtok_r(nullptr, " \t", &rest);
+		if (value == nullptr)
+		{
+			error = std::string("error ") + word + " needs a value";
+			return false;
+		}
+
+		if (strcmp(word, "frames") == 0)
+			job.frames = strtoull(value, nullptr, 10);
+		else if (strcmp(word, "cycles") == 0)
+			job.cycles = strtoull(value, nullptr, 10);
+		else if (strcmp(word, "seed") == 0)
+			job.seed = (uint32_t)strtoul(value, nullptr, 10);
+		else if (strcmp(word, "keys") == 0)
+		{
+			for (char* item = value; ; )
+			{
+				char* end;
+				KeyEvent event;
+				event.frame = strtoull(item, &end, 10);
+				bool valid = end != item && *end == ':';
+				if (valid)
+				{
+					event.mask = (uint16_t)strtoul(end + 1, &end, 16);
+					valid = (*end == ',' || *end == 0) && (job.keys.empty() || event.frame >= job.keys.back().frame);
+				}
+				if (!valid)
+				{
+					error = "error keys are FRAME:MASK,... in frame order";
+					return false;
+				}
+				job.keys.push_back(event);
+				if (*end == 0)
+					break;
+				item = end + 1;
+			}
+		}
+		else
+		{
+			error = std::string("error unknown run option ") + word;
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+	Runs a job on a worker's core from the booted ROM and returns the reply.
+*/
+template <class Machine>
+std::string Daemon<Machine>::run(Machine& core, const Job& job)
+{
+	core.restore(*job.rom);
+	core.set_seed(job.seed);
+
+	// Frame by frame like the frontend, so the timers tick at the same points
+	size_t next = 0;
+	for (uint64_t frame = 0; ; ++frame)
+	{
+		for (; next < job.keys.size() && job.keys[next].frame == frame; ++next)
+			core.set_keys(job.keys[next].mask);
+		if (frame == job.frames || core.get_exit() != 0)
+			break;
+		core.run_frame(cycles_per_frame);
+	}
+	core.run(job.cycles);
+
+	// The machine stops at 00FD or a trap, and every later run() returns at once
+	char line[64];
+	snprintf(line, sizeof(line), "%llu %s %016llx %llu", (unsigned long long)job.request, core.get_exit() != 0 ? "exited" : "ok",
+		(unsigned long long)core.state_hash(), (unsigned long long)core.get_cycles());
+	std::string reply = line;
+
+	if (job.capture)
+	{
+		static const char hex[] = "0123456789abcdef";
+		int width = core.screen_width(), height = core.screen_height();
+		snprintf(line, sizeof(line), " %d %d ", width, height);
+		reply += line;
+		for (int p = 0; p < Machine::variant::planes; ++p)
+			for (int bit = 0; bit < width * height; bit += 4)
+			{
+				int nibble = 0;
+				for (int i = 0; i < 4; ++i)
+					nibble = nibble << 1 | core.get_pixel((bit + i) % width, (bit + i) / width, p);
+				reply += hex[nibble];
+			}
+	}
+	return reply;
+}
+
+template <class Machine>
+void Daemon<Machine>::work()
+{
+	std::unique_ptr<Machine> core(new Machine(true));
+	core->set_muted(true);
+
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(queue_lock);
+			queue_ready.wait(lock, [this] { return stopping || !queue.empty(); });
+			if (queue.empty())
+				return;
+			job = std::move(queue.front());
+			queue.pop_front();
+		}
+		std::string reply = run(*core, job);
+
+		// Counted before the client can see the reply, so a stats request
+		// sent after it includes this job
+		{
+			std::lock_guard<std::mutex> lock(queue_lock);
+			++jobs_done;
+		}
+		Connection& connection = *job.connection;
+		connection.reply(reply);
+		--connection.jobs;
+
+		// Have the serving thread send what the socket did not take, or
+		// drop a connection whose last job this was
+		if (connection.has_output() || connection.is_done())
+		{
+			char c = 0;
+			if (write(wake[1], &c, 1) < 0)
+			{
+				// The pipe is full, so the serving thread wakes anyway
+			}
+		}
+	}
+}
+
+#else
+
+template <class Machine>
+Daemon<Machine>::Connection::~Connection()
+{
+}
+
+template <class Machine>
+Daemon<Machine>::Daemon(int, int cycles_per_frame)
+	: cycles_per_frame(cycles_per_frame), listener(-1), wake{ -1, -1 }, stopping(false), shutdown_requested(false), jobs_done(0)
+{
+}
+
+template <class Machine>
+Daemon<Machine>::~Daemon()
+{
+}
+
+template <class Machine>
+bool Daemon<Machine>::open(const char*)
+{
+	fprintf(stderr, "The daemon needs Unix sockets, which this build does not support\n");
+	return false;
+}
+
+template <class Machine>
+void Daemon<Machine>::serve()
+{
+}
+
+#endif
+
+template class Daemon<hadron8>;
+template class Daemon<schip8>;
+template class Daemon<xochip8>;
@@ -0,0 +1,123 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Long-running job server for tools that emulate many short runs. Instead
+// of starting a process, creating a machine and reading the ROM file for
+// each run, clients send jobs over a Unix socket to a pool of headless,
+// muted worker machines built once at startup. Every ROM is loaded and
+// pre-decoded once and kept booted in a cache; a job restores a worker from
+// it, which shares the ROM's pages copy-on-write, so it starts within
+// microseconds.
+//
+// The protocol is one request per line. Replies are one line each and
+// start with the number of the request on its connection (counting from
+// 0), since run jobs finish out of order:
+//
+//   load PATH                 -> N ok ROM_HASH
+//   run ROM_HASH frames F [cycles C] [seed S] [keys FRAME:MASK,...] [capture]
+//                             -> N ok STATE_HASH CYCLES [W H SCREEN]
+//   stats                     -> N ok roms R workers W jobs J queued Q
+//   quit                      closes the connection
+//   shutdown                  finishes queued jobs and stops the daemon
+//
+// Failures reply N error MESSAGE. Hashes are 16 hex digits. A run lasts F
+// frames plus C cycles from power-on with the random numbers seeded by S
+// (default 1), the timers ticking at the end of each frame as in the
+// emulator, so equal jobs give equal state hashes. A run that stops the
+// machine early (00FD, or a trap under HADRON8_BOUNDS_TRAP) replies
+// N exited instead of N ok, with the state it stopped in. keys sets the keypad
+// to a hex mask at the start of the given frames, in increasing order.
+// capture appends the final screen, each plane's pixels row by row as hex
+// with the leftmost pixel in the most significant bit.
+//
+// Instantiated for each variant of the core (hadron8, schip8, xochip8).
+// POSIX only.
+
+template <class Machine>
+class Daemon
+{
+public:
+	Daemon(int workers, int cycles_per_frame);
+	~Daemon();
+
+	// Listens on socket_path, replacing a stale socket left there
+	bool open(const char* socket_path);
+	// Serves clients until one sends shutdown
+	void serve();
+private:
+	// Sockets are non-blocking: replies the client has not taken yet wait
+	// in output, which the serving thread sends as the socket drains, so a
+	// client that stops reading holds up nobody else
+	struct Connection
+	{
+		int fd;
+		uint64_t requests;
+		std::string input;
+		std::atomic<bool> reading; // Until EOF, quit or shutdown
+		std::atomic<int> jobs;     // Queued or running, not replied yet
+		std::mutex write_lock;
+		std::string output;
+		bool broken;               // Write failed or backlog too long, output dropped
+
+		Connection(int fd) : fd(fd), requests(0), reading(true), jobs(0), broken(false) {}
+		~Connection();
+		void reply(const std::string& line);
+		void send();
+		bool has_output();
+		// Nothing left to read, run or send
+		bool is_done();
+	};
+
+	struct KeyEvent
+	{
+		uint64_t frame;
+		uint16_t mask;
+	};
+
+	struct Job
+	{
+		std::shared_ptr<Connection> connection;
+		uint64_t request;
+		const Machine* rom;
+		uint64_t frames;
+		uint64_t cycles; // Run after the frames
+		uint32_t seed;
+		std::vector<KeyEvent> keys;
+		bool capture;
+	};
+
+	uint64_t cycles_per_frame;
+	int listener;
+	int wake[2];    // Workers write to wake[1] when the serving thread has replies to send
+	std::string socket_path;
+
+	// Booted machines by ROM hash; only the serving thread touches the map,
+	// workers only read the machines, which are never removed
+	std::unordered_map<uint64_t, std::unique_ptr<Machine>> roms;
+
+	std::vector<std::thread> workers;
+	std::deque<Job> queue;
+	std::mutex queue_lock;
+	std::condition_variable queue_ready;
+	bool stopping;          // Workers exit once the queue is empty
+	bool shutdown_requested;
+	uint64_t jobs_done;
+
+	bool handle(const std::shared_ptr<Connection>& connection, char* line);
+	std::string load(const char* path);
+	bool parse_run(Job& job, char* args, std::string& error);
+	std::string run(Machine& core, const Job& job);
+	void work();
+
+	Daemon(const Daemon&) = delete;
+	Daemon& operator=(const Daemon&) = delete;
+};
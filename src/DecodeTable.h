@@ -0,0 +1,156 @@
+#pragma once
+#include <cstdint>
+
+#include "Variant.h"
+
+// Every 16-bit opcode decoded once, at compile time: the handler that
+// executes it plus its operand fields, so dispatch is a single table
+// lookup. There is one table per variant; opcodes that are not defined
+// instructions of the variant map to the invalid handler and have
+// valid == 0.
+//
+// Each table is 512 KB. MSVC needs a raised constexpr step limit to build
+// them (/constexpr:steps10000000).
+
+#define HADRON8_HANDLERS(X) \
+	X(invalid) \
+	X(00E0) X(00EE) X(1NNN) X(2NNN) X(3XNN) X(4XNN) X(5XY0) X(6XNN) \
+	X(7XNN) X(8XY0) X(8XY1) X(8XY2) X(8XY3) X(8XY4) X(8XY5) X(8XY6) \
+	X(8XY7) X(8XYE) X(9XY0) X(ANNN) X(BNNN) X(CXNN) X(DXYN) X(EX9E) \
+	X(EXA1) X(FX07) X(FX0A) X(FX15) X(FX18) X(FX1E) X(FX29) X(FX33) \
+	X(FX55) X(FX65) \
+	X(00CN) X(00DN) X(00FB) X(00FC) X(00FD) X(00FE) X(00FF) X(5XY2) \
+	X(5XY3) X(F000NNNN) X(FN01) X(F002) X(FX30) X(FX3A) X(FX75) X(FX85)
+
+enum DecodedHandler : uint8_t
+{
+#define HADRON8_HANDLER_ID(name) handler_##name,
+	HADRON8_HANDLERS(HADRON8_HANDLER_ID)
+#undef HADRON8_HANDLER_ID
+	handler_count
+};
+
+struct DecodedOp
+{
+	uint8_t handler;
+	uint8_t x;
+	uint8_t y;
+	uint8_t n;
+	uint8_t nn;
+	uint8_t valid;
+	uint16_t nnn;
+};
+static_assert(sizeof(DecodedOp) == 8, "eight entries per 64 byte cache line");
+
+template <class Variant>
+constexpr uint8_t decode_handler(uint16_t op)
+{
+	switch (op & 0xF000)
+	{
+	case 0x0000:
+		if (op == 0x00E0) return handler_00E0;
+		if (op == 0x00EE) return handler_00EE;
+		if (Variant::schip)
+		{
+			if ((op & 0xFFF0) == 0x00C0) return handler_00CN;
+			if (op == 0x00FB) return handler_00FB;
+			if (op == 0x00FC) return handler_00FC;
+			if (op == 0x00FD) return handler_00FD;
+			if (op == 0x00FE) return handler_00FE;
+			if (op == 0x00FF) return handler_00FF;
+		}
+		if (Variant::xochip && (op & 0xFFF0) == 0x00D0) return handler_00DN;
+		return handler_invalid;
+	case 0x1000: return handler_1NNN;
+	case 0x2000: return handler_2NNN;
+	case 0x3000: return handler_3XNN;
+	case 0x4000: return handler_4XNN;
+	case 0x5000:
+		if ((op & 0x000F) == 0x0) return handler_5XY0;
+		if (Variant::xochip && (op & 0x000F) == 0x2) return handler_5XY2;
+		if (Variant::xochip && (op & 0x000F) == 0x3) return handler_5XY3;
+		return handler_invalid;
+	case 0x6000: return handler_6XNN;
+	case 0x7000: return handler_7XNN;
+	case 0x8000:
+		switch (op & 0x000F)
+		{
+		case 0x0: return handler_8XY0;
+		case 0x1: return handler_8XY1;
+		case 0x2: return handler_8XY2;
+		case 0x3: return handler_8XY3;
+		case 0x4: return handler_8XY4;
+		case 0x5: return handler_8XY5;
+		case 0x6: return handler_8XY6;
+		case 0x7: return handler_8XY7;
+		case 0xE: return handler_8XYE;
+		default: return handler_invalid;
+		}
+	case 0x9000: return (op & 0x000F) == 0x0 ? handler_9XY0 : handler_invalid;
+	case 0xA000: return handler_ANNN;
+	case 0xB000: return handler_BNNN;
+	case 0xC000: return handler_CXNN;
+	case 0xD000: return handler_DXYN;
+	case 0xE000:
+		if ((op & 0x00FF) == 0x9E) return handler_EX9E;
+		if ((op & 0x00FF) == 0xA1) return handler_EXA1;
+		return handler_invalid;
+	default:
+		if (Variant::xochip)
+		{
+			if (op == 0xF000) return handler_F000NNNN;
+			if (op == 0xF002) return handler_F002;
+			if ((op & 0x00FF) == 0x01) return handler_FN01;
+			if ((op & 0x00FF) == 0x3A) return handler_FX3A;
+		}
+		if (Variant::schip)
+		{
+			if ((op & 0x00FF) == 0x30) return handler_FX30;
+			if ((op & 0x00FF) == 0x75) return handler_FX75;
+			if ((op & 0x00FF) == 0x85) return handler_FX85;
+		}
+		switch (op & 0x00FF)
+		{
+		case 0x07: return handler_FX07;
+		case 0x0A: return handler_FX0A;
+		case 0x15: return handler_FX15;
+		case 0x18: return handler_FX18;
+		case 0x1E: return handler_FX1E;
+		case 0x29: return handler_FX29;
+		case 0x33: return handler_FX33;
+		case 0x55: return handler_FX55;
+		case 0x65: return handler_FX65;
+		default: return handler_invalid;
+		}
+	}
+}
+
+struct DecodeTable
+{
+	DecodedOp ops[65536];
+};
+
+template <class Variant>
+constexpr DecodeTable make_decode_table()
+{
+	DecodeTable table = {};
+	for (uint32_t i = 0; i < 65536; ++i)
+	{
+		uint16_t op = (uint16_t)i;
+		DecodedOp& d = table.ops[i];
+		d.handler = decode_handler<Variant>(op);
+		d.x = (op & 0x0F00) >> 8;
+		d.y = (op & 0x00F0) >> 4;
+		d.n = op & 0x000F;
+		d.nn = op & 0x00FF;
+		d.valid = d.handler != handler_invalid;
+		d.nnn = op & 0x0FFF;
+	}
+	return table;
+}
+
+template <class Variant>
+inline constexpr DecodeTable decode_table_for = make_decode_table<Variant>();
+
+// The plain CHIP-8 table, which the tools disassemble and compile against
+inline constexpr const DecodeTable& decode_table = decode_table_for<chip8_variant>;
@@ -0,0 +1,76 @@
+#include "Disassembler.h"
+#include "DecodeTable.h"
+
+#include <cstdio>
+
+int disassemble(uint16_t opcode, char* out, size_t size)
+{
+	unsigned x = (opcode & 0x0F00) >> 8;
+	unsigned y = (opcode & 0x00F0) >> 4;
+	unsigned n = opcode & 0x000F;
+	unsigned nn = opcode & 0x00FF;
+	unsigned nnn = opcode & 0x0FFF;
+
+	switch (opcode & 0xF000)
+	{
+	case 0x0000:
+		if (opcode == 0x00E0) return snprintf(out, size, "CLS");
+		if (opcode == 0x00EE) return snprintf(out, size, "RET");
+		break;
+	case 0x1000: return snprintf(out, size, "JP 0x%03X", nnn);
+	case 0x2000: return snprintf(out, size, "CALL 0x%03X", nnn);
+	case 0x3000: return snprintf(out, size, "SE V%X, 0x%02X", x, nn);
+	case 0x4000: return snprintf(out, size, "SNE V%X, 0x%02X", x, nn);
+	case 0x5000:
+		if (n == 0x0) return snprintf(out, size, "SE V%X, V%X", x, y);
+		break;
+	case 0x6000: return snprintf(out, size, "LD V%X, 0x%02X", x, nn);
+	case 0x7000: return snprintf(out, size, "ADD V%X, 0x%02X", x, nn);
+	case 0x8000:
+		switch (n)
+		{
+		case 0x0: return snprintf(out, size, "LD V%X, V%X", x, y);
+		case 0x1: return snprintf(out, size, "OR V%X, V%X", x, y);
+		case 0x2: return snprintf(out, size, "AND V%X, V%X", x, y);
+		case 0x3: return snprintf(out, size, "XOR V%X, V%X", x, y);
+		case 0x4: return snprintf(out, size, "ADD V%X, V%X", x, y);
+		case 0x5: return snprintf(out, size, "SUB V%X, V%X", x, y);
+		case 0x6: return snprintf(out, size, "SHR V%X", x);
+		case 0x7: return snprintf(out, size, "SUBN V%X, V%X", x, y);
+		case 0xE: return snprintf(out, size, "SHL V%X", x);
+		}
+		break;
+	case 0x9000:
+		if (n == 0x0) return snprintf(out, size, "SNE V%X, V%X", x, y);
+		break;
+	case 0xA000: return snprintf(out, size, "LD I, 0x%03X", nnn);
+	case 0xB000: return snprintf(out, size, "JP V0, 0x%03X", nnn);
+	case 0xC000: return snprintf(out, size, "RND V%X, 0x%02X", x, nn);
+	case 0xD000: return snprintf(out, size, "DRW V%X, V%X, %u", x, y, n);
+	case 0xE000:
+		if (nn == 0x9E) return snprintf(out, size, "SKP V%X", x);
+		if (nn == 0xA1) return snprintf(out, size, "SKNP V%X", x);
+		break;
+	case 0xF000:
+		switch (nn)
+		{
+		case 0x07: return snprintf(out, size, "LD V%X, DT", x);
+		case 0x0A: return snprintf(out, size, "LD V%X, K", x);
+		case 0x15: return snprintf(out, size, "LD DT, V%X", x);
+		case 0x18: return snprintf(out, size, "LD ST, V%X", x);
+		case 0x1E: return snprintf(out, size, "ADD I, V%X", x);
+		case 0x29: return snprintf(out, size, "LD F, V%X", x);
+		case 0x33: return snprintf(out, size, "LD B, V%X", x);
+		case 0x55: return snprintf(out, size, "LD [I], V%X", x);
+		case 0x65: return snprintf(out, size, "LD V%X, [I]", x);
+		}
+		break;
+	}
+
+	return snprintf(out, size, "DW 0x%04X", opcode);
+}
+
+bool is_valid_opcode(uint16_t opcode)
+{
+	return decode_table.ops[opcode].valid != 0;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Formats one CHIP-8 instruction in the usual assembler mnemonics
+// (CLS, JP 0x2A0, LD V1, 0x04, DRW V0, V1, 5, ...). Writes at most
+// size bytes including the terminator and returns the text length.
+// Undefined opcodes come out as data words (DW 0x1234).
+
+int disassemble(uint16_t opcode, char* out, size_t size);
+
+// True if the opcode is a defined CHIP-8 instruction
+bool is_valid_opcode(uint16_t opcode);
@@ -0,0 +1,91 @@
+#include "FramePacer.h"
+
+#include <cstdio>
+#include <ctime>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+FramePacer::FramePacer(double hz)
+	: period(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / hz))),
+		spin_threshold(std::chrono::microseconds(500)),
+		frames(0), late_frames(0), jitter_sum_us(0.0), jitter_max_us(0.0)
+{
+#ifdef _WIN32
+	// Default scheduler granularity is ~15 ms, far coarser than one frame
+	timeBeginPeriod(1);
+#endif
+	wall_start = clock::now();
+	cpu_start = thread_cpu_seconds();
+	deadline = wall_start + period;
+}
+
+FramePacer::~FramePacer()
+{
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+}
+
+void FramePacer::wait()
+{
+	clock::time_point now = clock::now();
+
+	// Sleep through most of the remaining time, then spin for the tail
+	if (deadline - now > spin_threshold)
+		std::this_thread::sleep_until(deadline - spin_threshold);
+	while ((now = clock::now()) < deadline)
+		std::this_thread::yield();
+
+	double late_us = std::chrono::duration<double, std::micro>(now - deadline).count();
+	jitter_sum_us += late_us;
+	if (late_us > jitter_max_us)
+		jitter_max_us = late_us;
+	++frames;
+
+	// If a whole frame was missed, start over from now instead of
+	// running a burst of frames to catch up
+	if (now - deadline > period)
+	{
+		++late_frames;
+		deadline = now + period;
+	}
+	else
+		deadline += period;
+}
+
+double FramePacer::get_cpu_usage() const
+{
+	double wall = std::chrono::duration<double>(clock::now() - wall_start).count();
+	if (wall <= 0.0)
+		return 0.0;
+	return (thread_cpu_seconds() - cpu_start) / wall * 100.0;
+}
+
+double FramePacer::thread_cpu_seconds()
+{
+#if defined(_WIN32)
+	FILETIME creation, exit, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime; k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime; u.HighPart = user.dwHighDateTime;
+	return (k.QuadPart + u.QuadPart) * 1e-7;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+	return (double)std::clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+void FramePacer::debug_pacing()
+{
+	printf("Frames: %llu (%llu late)\n", (unsigned long long)frames, (unsigned long long)late_frames);
+	printf("Frame jitter: avg %.1f us, max %.1f us\n", get_jitter_avg_us(), get_jitter_max_us());
+	printf("CPU usage: %.1f%%\n", get_cpu_usage());
+}
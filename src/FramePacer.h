@@ -0,0 +1,38 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+// Sleeps the emulation loop until each frame deadline instead of spinning.
+// The bulk of the wait is an OS sleep; only the last spin_threshold of it
+// is spent busy-waiting so the wakeup lands close to the deadline.
+
+class FramePacer
+{
+public:
+	FramePacer(double hz = 60.0);
+	~FramePacer();
+
+	void wait();
+	void debug_pacing();
+
+	inline double get_jitter_avg_us() const { return frames == 0 ? 0.0 : jitter_sum_us / frames; }
+	inline double get_jitter_max_us() const { return jitter_max_us; }
+	inline uint64_t get_frames() const { return frames; }
+	double get_cpu_usage() const;
+private:
+	typedef std::chrono::steady_clock clock;
+
+	clock::duration period;
+	clock::duration spin_threshold;
+	clock::time_point deadline;
+
+	clock::time_point wall_start;
+	double cpu_start;
+
+	uint64_t frames;
+	uint64_t late_frames;
+	double jitter_sum_us;
+	double jitter_max_us;
+
+	static double thread_cpu_seconds();
+};
@@ -0,0 +1,51 @@
+#include "Keymap.h"
+
+#include <cstdio>
+#include <cstring>
+
+Keymap::Keymap()
+{
+	memset(keys, -1, sizeof(keys));
+	parse(default_layout);
+}
+
+bool Keymap::parse(const char* layout)
+{
+	SDL_Scancode codes[16];
+	int count = 0;
+	bool names = strchr(layout, ',') != nullptr;
+
+	for (const char* p = layout; *p != 0; ++count)
+	{
+		char name[32];
+		size_t length = names ? strcspn(p, ",") : 1;
+		if (count == 16 || length == 0 || length >= sizeof(name))
+		{
+			count = -1;
+			break;
+		}
+		memcpy(name, p, length);
+		name[length] = 0;
+		p += length;
+		if (names && *p == ',')
+			++p;
+
+		codes[count] = SDL_GetScancodeFromName(name);
+		if (codes[count] == SDL_SCANCODE_UNKNOWN)
+		{
+			fprintf(stderr, "Unknown key in keymap: %s\n", name);
+			return false;
+		}
+	}
+
+	if (count != 16)
+	{
+		fprintf(stderr, "A keymap names 16 keys, for keypad keys 0 to F: %s\n", layout);
+		return false;
+	}
+
+	memset(keys, -1, sizeof(keys));
+	for (int i = 0; i < 16; ++i)
+		keys[codes[i]] = (int8_t)i;
+	return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+
+#include <SDL.h>
+
+// Host keys for the 16 keys of the hex keypad, looked up by scancode. The
+// default layout puts the keypad on the left of a QWERTY keyboard:
+//
+//   Keypad       Keyboard
+//   1 2 3 C      1 2 3 4
+//   4 5 6 D  =>  Q W E R
+//   7 8 9 E      A S D F
+//   A 0 B F      Z X C V
+
+class Keymap
+{
+public:
+	// Keypad keys 0 to F of the default layout
+	static constexpr const char* default_layout = "X123QWEASDZC4RFV";
+
+	Keymap();
+
+	// Maps the keypad keys 0 to F, in order, to the keys named by layout:
+	// either 16 characters or 16 SDL key names separated by commas (e.g.
+	// "Keypad 0,Keypad 1,..."). Leaves the map unchanged on an error.
+	bool parse(const char* layout);
+
+	// Keypad key a host key is mapped to, -1 if none
+	inline int key_for(SDL_Scancode code) const { return code >= 0 && code < SDL_NUM_SCANCODES ? keys[code] : -1; }
+private:
+	int8_t keys[SDL_NUM_SCANCODES];
+};
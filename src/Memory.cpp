@@ -0,0 +1,56 @@
+#include "Memory.h"
+#include "Pool.h"
+
+#include <cstring>
+
+typedef Pool<sizeof(Page)> PagePool;
+
+void* Page::operator new(size_t)
+{
+	return PagePool::allocate();
+}
+
+void Page::operator delete(void* p)
+{
+	PagePool::release(p);
+}
+
+void Page::release(Page* p)
+{
+	if (p->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		delete p;
+}
+
+Page* Page::unshare(Page* p)
+{
+	Page* copy = new Page;
+	memcpy(copy->data, p->data, size);
+	release(p);
+	return copy;
+}
+
+uint64_t rom_hash(const uint8_t* program, size_t size, uint64_t hash)
+{
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= program[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+Rom::Rom(const uint8_t* image, size_t image_size, size_t program_size)
+	: pages(image_size / Page::size), program_size(program_size), hash(rom_hash(image + 0x200, program_size))
+{
+	for (int i = 0; i < (int)pages.size(); ++i)
+	{
+		pages[i] = new Page;
+		memcpy(pages[i]->data, image + i * Page::size, Page::size);
+	}
+}
+
+Rom::~Rom()
+{
+	for (int i = 0; i < (int)pages.size(); ++i)
+		Page::release(pages[i]);
+}
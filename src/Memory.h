@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// CHIP-8 memory is held in small reference-counted pages so a machine can
+// be forked without copying its 4 KB address space. Pages are shared until
+// one of the owners writes to them (copy-on-write).
+
+struct Page
+{
+	static const int bits = 8;
+	static const int size = 1 << bits;
+	static const int mask = size - 1;
+
+	std::atomic<uint32_t> refs;
+	uint8_t data[size];
+
+	Page() : refs(1) {}
+
+	static void* operator new(size_t);
+	static void operator delete(void*);
+
+	inline Page* retain() { refs.fetch_add(1, std::memory_order_relaxed); return this; }
+	static void release(Page*);
+
+	// Returns a private copy of p for the caller, dropping its reference to p
+	static Page* unshare(Page* p);
+};
+
+// FNV-1a hash identifying a ROM by its program bytes. Passing the result
+// back in as hash continues it over more bytes.
+uint64_t rom_hash(const uint8_t* program, size_t size, uint64_t hash = 0xcbf29ce484222325ull);
+
+// An instruction decoded when its ROM was loaded (see Analysis)
+struct PredecodedOp
+{
+	uint16_t opcode;
+	uint8_t next;  // Top nibble of the following opcode, which picks a fused pair
+	uint8_t valid; // 0 where nothing was decoded
+};
+
+// Immutable memory image a machine boots from (font set plus program, 4 KB
+// or 64 KB depending on the variant). Its pages are shared by every machine
+// loaded from it and all their forks.
+
+class Rom
+{
+public:
+	Rom(const uint8_t* image, size_t image_size, size_t program_size);
+	~Rom();
+
+	inline Page* page(int i) const { return pages[i]; }
+	inline int get_page_count() const { return (int)pages.size(); }
+	inline size_t get_program_size() const { return program_size; }
+	inline uint64_t get_hash() const { return hash; }
+
+	// Instructions decoded ahead of time, indexed by address. Empty unless
+	// set before the Rom is shared with any machine.
+	inline void set_code(std::vector<PredecodedOp> ops) { code = std::move(ops); }
+	inline size_t get_code_size() const { return code.size(); }
+	inline const PredecodedOp& code_at(uint16_t addr) const { return code[addr]; }
+private:
+	std::vector<Page*> pages;
+	std::vector<PredecodedOp> code;
+	size_t program_size;
+	uint64_t hash; // FNV-1a of the program bytes
+
+	Rom(const Rom&) = delete;
+	Rom& operator=(const Rom&) = delete;
+};
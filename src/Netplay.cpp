@@ -0,0 +1,363 @@
+#include "Netplay.h"
+#include "hadron8.h"
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+// Packet layout, little endian:
+//   "H8NP", first frame (u32), frames of the peer's keys received (u32),
+//   key count (u8), key masks (u16 each) for first, first + 1, ...
+static const uint8_t magic[4] = { 'H', '8', 'N', 'P' };
+static const size_t header_size = 13;
+
+// Peer is considered gone after this long without a packet
+static const std::chrono::seconds peer_timeout(5);
+
+static void put32(std::vector<uint8_t>& out, uint32_t v)
+{
+	for (int i = 0; i < 4; ++i)
+		out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static uint32_t get32(const uint8_t* in)
+{
+	return in[0] | in[1] << 8 | in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+template <class Machine>
+Netplay<Machine>::Netplay(int cycles_per_frame)
+	: cycles_per_frame(cycles_per_frame), sock(INVALID_SOCKET), peer_ip(0), peer_port(0), connected(false),
+		delay_ms(0), loss(0.0), loss_rng(0x2545F491),
+		current(0), remote_confirmed(0), peer_ack(0), rollback_from(INT64_MAX),
+		rollbacks(0), resimulated(0), stalls(0)
+{
+	for (int i = 0; i < ring; ++i)
+	{
+		local_keys[i] = remote_keys[i] = used_keys[i] = 0;
+		remote_frame[i] = -1;
+		snapshots[i] = nullptr;
+	}
+}
+
+template <class Machine>
+Netplay<Machine>::~Netplay()
+{
+	for (int i = 0; i < ring; ++i)
+		delete snapshots[i];
+	if (sock != INVALID_SOCKET)
+		closesocket(sock);
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+template <class Machine>
+bool Netplay<Machine>::open(uint16_t local_port, const char* host, uint16_t port)
+{
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+	{
+		fprintf(stderr, "WSAStartup failed\n");
+		return false;
+	}
+#endif
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	addrinfo* peer = nullptr;
+	if (getaddrinfo(host, nullptr, &hints, &peer) != 0 || peer == nullptr)
+	{
+		fprintf(stderr, "Cannot resolve %s\n", host);
+		return false;
+	}
+	peer_ip = ((sockaddr_in*)peer->ai_addr)->sin_addr.s_addr;
+	peer_port = htons(port);
+	freeaddrinfo(peer);
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock == INVALID_SOCKET)
+	{
+		fprintf(stderr, "Cannot create UDP socket\n");
+		return false;
+	}
+
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons(local_port);
+	if (bind(sock, (sockaddr*)&local, sizeof(local)) != 0)
+	{
+		fprintf(stderr, "Cannot bind UDP port %d\n", local_port);
+		return false;
+	}
+
+	// Never block the emulation loop on the network
+#ifdef _WIN32
+	u_long nonblocking = 1;
+	ioctlsocket(sock, FIONBIO, &nonblocking);
+#else
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
+	return true;
+}
+
+template <class Machine>
+void Netplay<Machine>::set_shim(int delay, double drop)
+{
+	delay_ms = delay;
+	loss = drop;
+}
+
+template <class Machine>
+bool Netplay<Machine>::wait_for_peer(int timeout_ms)
+{
+	clock::time_point deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+	while (clock::now() < deadline)
+	{
+		send_inputs();
+		for (int i = 0; i < 50 && !connected; ++i)
+		{
+			flush();
+			receive();
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+		if (connected)
+		{
+			// Make sure the peer heard us too before it times out
+			send_inputs();
+			return true;
+		}
+	}
+	fprintf(stderr, "No answer from the netplay peer\n");
+	return false;
+}
+
+template <class Machine>
+void Netplay<Machine>::send_packet(const std::vector<uint8_t>& data)
+{
+	if (loss > 0.0)
+	{
+		loss_rng ^= loss_rng << 13;
+		loss_rng ^= loss_rng >> 17;
+		loss_rng ^= loss_rng << 5;
+		if (loss_rng / 4294967296.0 < loss)
+			return;
+	}
+	Delayed packet;
+	packet.release = clock::now() + std::chrono::milliseconds(delay_ms);
+	packet.data = data;
+	outgoing.push_back(packet);
+	flush();
+}
+
+template <class Machine>
+void Netplay<Machine>::flush()
+{
+	sockaddr_in to;
+	memset(&to, 0, sizeof(to));
+	to.sin_family = AF_INET;
+	to.sin_addr.s_addr = peer_ip;
+	to.sin_port = peer_port;
+
+	clock::time_point now = clock::now();
+	while (!outgoing.empty() && outgoing.front().release <= now)
+	{
+		const std::vector<uint8_t>& data = outgoing.front().data;
+		sendto(sock, (const char*)data.data(), (int)data.size(), 0, (sockaddr*)&to, sizeof(to));
+		outgoing.pop_front();
+	}
+}
+
+template <class Machine>
+void Netplay<Machine>::send_inputs()
+{
+	int64_t first = peer_ack;
+	int count = (int)(current - first);
+	if (count > max_inputs)
+		count = max_inputs;
+
+	std::vector<uint8_t> packet(magic, magic + 4);
+	put32(packet, (uint32_t)first);
+	put32(packet, (uint32_t)remote_confirmed);
+	packet.push_back((uint8_t)count);
+	for (int i = 0; i < count; ++i)
+	{
+		uint16_t keys = local_keys[(first + i) % ring];
+		packet.push_back((uint8_t)keys);
+		packet.push_back((uint8_t)(keys >> 8));
+	}
+	send_packet(packet);
+}
+
+template <class Machine>
+void Netplay<Machine>::receive()
+{
+	uint8_t buffer[header_size + 2 * 255];
+	for (;;)
+	{
+		sockaddr_in from;
+		socklen_t from_size = sizeof(from);
+		int size = (int)recvfrom(sock, (char*)buffer, sizeof(buffer), 0, (sockaddr*)&from, &from_size);
+		if (size < 0)
+			break;
+		if (size < (int)header_size || memcmp(buffer, magic, 4) != 0 ||
+			from.sin_addr.s_addr != peer_ip || from.sin_port != peer_port)
+			continue;
+
+		connected = true;
+		last_heard = clock::now();
+
+		int64_t first = get32(buffer + 4);
+		int64_t ack = get32(buffer + 8);
+		int count = buffer[12];
+		if (size < (int)header_size + 2 * count)
+			continue;
+		if (ack > peer_ack)
+			peer_ack = ack;
+
+		for (int i = 0; i < count; ++i)
+		{
+			int64_t f = first + i;
+			if (f < remote_confirmed || f >= remote_confirmed + ring - max_rollback)
+				continue;
+			remote_keys[f % ring] = buffer[header_size + 2 * i] | buffer[header_size + 2 * i + 1] << 8;
+			remote_frame[f % ring] = f;
+		}
+
+		// Confirm frames in order; a frame already run with other keys
+		// has to be run again
+		while (remote_frame[remote_confirmed % ring] == remote_confirmed)
+		{
+			if (remote_confirmed < current && used_keys[remote_confirmed % ring] != remote_keys[remote_confirmed % ring] &&
+				remote_confirmed < rollback_from)
+				rollback_from = remote_confirmed;
+			++remote_confirmed;
+		}
+	}
+
+	if (connected && clock::now() - last_heard > peer_timeout)
+	{
+		fprintf(stderr, "Netplay peer timed out\n");
+		connected = false;
+	}
+}
+
+// Known keys of the peer for frame, or a guess: the last ones it sent
+template <class Machine>
+uint16_t Netplay<Machine>::remote_keys_for(int64_t frame) const
+{
+	if (remote_frame[frame % ring] == frame)
+		return remote_keys[frame % ring];
+	if (remote_confirmed == 0)
+		return 0;
+	return remote_keys[(remote_confirmed - 1) % ring];
+}
+
+// Runs one frame from the current state of h8, snapshotting it first
+template <class Machine>
+void Netplay<Machine>::step(Machine& h8, int64_t frame)
+{
+	Machine*& snapshot = snapshots[frame % ring];
+	delete snapshot;
+	snapshot = h8.fork();
+
+	uint16_t remote = remote_keys_for(frame);
+	used_keys[frame % ring] = remote;
+	h8.set_keys(local_keys[frame % ring] | remote);
+	h8.run_frame(cycles_per_frame);
+}
+
+// Rewinds to the first mispredicted frame and catches up, muted so the
+// replayed frames do not beep again
+template <class Machine>
+void Netplay<Machine>::roll_back(Machine& h8)
+{
+	if (rollback_from < current)
+	{
+		bool muted = h8.is_muted();
+		h8.set_muted(true);
+		h8.restore(*snapshots[rollback_from % ring]);
+		for (int64_t f = rollback_from; f < current; ++f)
+			step(h8, f);
+		h8.set_muted(muted);
+
+		++rollbacks;
+		resimulated += current - rollback_from;
+	}
+	rollback_from = INT64_MAX;
+}
+
+template <class Machine>
+bool Netplay<Machine>::frame(Machine& h8)
+{
+	uint16_t local = h8.get_keys();
+
+	flush();
+	receive();
+	if (!connected)
+		return false;
+	roll_back(h8);
+
+	// Too far ahead of the peer to roll back if it turns out wrong
+	if (current - remote_confirmed >= max_rollback)
+	{
+		++stalls;
+		h8.set_keys(local);
+		send_inputs();
+		return false;
+	}
+
+	local_keys[current % ring] = local;
+	step(h8, current);
+	++current;
+
+	// Leave the local keys for the keyboard handler to update
+	h8.set_keys(local);
+	send_inputs();
+	return true;
+}
+
+template <class Machine>
+bool Netplay<Machine>::settle(Machine& h8)
+{
+	uint16_t local = h8.get_keys();
+
+	flush();
+	receive();
+	roll_back(h8);
+	h8.set_keys(local);
+	send_inputs();
+	return remote_confirmed >= current && peer_ack >= current;
+}
+
+template <class Machine>
+void Netplay<Machine>::debug_netplay()
+{
+	printf("Netplay: %lld frames, %llu rollbacks, %llu frames simulated again, %llu stalls\n",
+		(long long)current, (unsigned long long)rollbacks, (unsigned long long)resimulated, (unsigned long long)stalls);
+}
+
+template class Netplay<hadron8>;
+template class Netplay<schip8>;
+template class Netplay<xochip8>;
@@ -0,0 +1,103 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+template <class Variant> class basic_hadron8;
+
+// Two-player rollback netplay over UDP. Both hosts run the same ROM from the
+// same seed; the keypad each frame is the OR of both players' keys. Every
+// frame the local keys are sent to the peer tagged with their frame number,
+// and the frame runs at once with the peer's keys predicted to be the last
+// ones received. When the real keys for a past frame arrive and differ from
+// the prediction, the machine is restored to its snapshot of that frame and
+// the frames since are simulated again, all within the current host frame.
+//
+// Packets carry every frame the peer has not acknowledged yet, so a lost
+// packet is repaired by the next one. For testing on one machine, outgoing
+// packets can be delayed and dropped (set_shim).
+//
+// Instantiated for each variant of the core (hadron8, schip8, xochip8).
+
+template <class Machine>
+class Netplay
+{
+public:
+	// Frames a host may run ahead of the last keys confirmed by its peer
+	static const int max_rollback = 16;
+
+	Netplay(int cycles_per_frame);
+	~Netplay();
+
+	// Binds local_port and sends to host:port
+	bool open(uint16_t local_port, const char* host, uint16_t port);
+	// Adds delay_ms to every outgoing packet and drops loss (0-1) of them
+	void set_shim(int delay_ms, double loss);
+	// Waits until the peer answers; both hosts start at frame 0 after this
+	bool wait_for_peer(int timeout_ms);
+
+	// Emulates the next frame of h8 with its current keys as the local
+	// player's. Returns false when it has to wait for the peer instead.
+	bool frame(Machine& h8);
+	// Exchanges keys without emulating further and corrects any
+	// misprediction. True once every frame run so far used the peer's
+	// real keys, i.e. both hosts agree on the state.
+	bool settle(Machine& h8);
+
+	inline bool is_connected() const { return connected; }
+	inline int64_t get_frame() const { return current; }
+	inline uint64_t get_rollbacks() const { return rollbacks; }
+	inline uint64_t get_resimulated() const { return resimulated; }
+	inline uint64_t get_stalls() const { return stalls; }
+	void debug_netplay();
+private:
+	typedef std::chrono::steady_clock clock;
+
+	static const int ring = 64;
+	static const int max_inputs = 64;
+
+	struct Delayed
+	{
+		clock::time_point release;
+		std::vector<uint8_t> data;
+	};
+
+	uint64_t cycles_per_frame;
+	intptr_t sock;
+	uint32_t peer_ip;
+	uint16_t peer_port;
+	bool connected;
+	clock::time_point last_heard;
+
+	int delay_ms;
+	double loss;
+	uint32_t loss_rng;
+	std::deque<Delayed> outgoing;
+
+	int64_t current;          // Next frame to emulate
+	int64_t remote_confirmed; // Frames of peer keys received without gaps
+	int64_t peer_ack;         // Frames of our keys the peer has received
+	int64_t rollback_from;    // Earliest frame run with a wrong prediction
+
+	uint16_t local_keys[ring];
+	uint16_t remote_keys[ring];
+	int64_t remote_frame[ring]; // Frame remote_keys[i] belongs to, -1 if none
+	uint16_t used_keys[ring];   // Peer keys each frame was run with
+	Machine* snapshots[ring];   // State at the start of each frame
+
+	uint64_t rollbacks;
+	uint64_t resimulated;
+	uint64_t stalls;
+
+	void receive();
+	void send_inputs();
+	void send_packet(const std::vector<uint8_t>&);
+	void flush();
+	uint16_t remote_keys_for(int64_t frame) const;
+	void step(Machine& h8, int64_t frame);
+	void roll_back(Machine& h8);
+
+	Netplay(const Netplay&) = delete;
+	Netplay& operator=(const Netplay&) = delete;
+};
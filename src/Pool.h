@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Fixed-size block allocator for objects that are created and destroyed
+// in large numbers (forked machines, memory pages). Blocks are carved out
+// of chunks of blocks_per_chunk and recycled through a per-thread free
+// list, so steady-state allocation never reaches the global heap. Chunks
+// are kept for the lifetime of the process.
+
+template <size_t Size, size_t BlocksPerChunk = 256>
+class Pool
+{
+public:
+	static void* allocate()
+	{
+		if (free_list == nullptr)
+			grow();
+		Block* block = free_list;
+		free_list = block->next;
+		return block;
+	}
+
+	static void release(void* p)
+	{
+		if (p == nullptr)
+			return;
+		Block* block = static_cast<Block*>(p);
+		block->next = free_list;
+		free_list = block;
+	}
+private:
+	union Block
+	{
+		Block* next;
+		alignas(std::max_align_t) unsigned char data[Size];
+	};
+
+	static thread_local Block* free_list;
+
+	static void grow()
+	{
+		Block* chunk = static_cast<Block*>(std::malloc(sizeof(Block) * BlocksPerChunk));
+		if (chunk == nullptr)
+			throw std::bad_alloc();
+		for (size_t i = 0; i < BlocksPerChunk; ++i)
+		{
+			chunk[i].next = free_list;
+			free_list = &chunk[i];
+		}
+	}
+};
+
+template <size_t Size, size_t BlocksPerChunk>
+thread_local typename Pool<Size, BlocksPerChunk>::Block* Pool<Size, BlocksPerChunk>::free_list = nullptr;
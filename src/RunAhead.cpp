@@ -0,0 +1,34 @@
+#include "RunAhead.h"
+#include "hadron8.h"
+
+template <class Machine>
+RunAhead<Machine>::RunAhead(int frames, int cycles_per_frame)
+	: frames(frames), cycles_per_frame(cycles_per_frame), ahead(nullptr)
+{
+}
+
+template <class Machine>
+RunAhead<Machine>::~RunAhead()
+{
+	delete ahead;
+}
+
+template <class Machine>
+const Machine& RunAhead<Machine>::frame(Machine& h8)
+{
+	h8.run_frame(cycles_per_frame);
+	if (frames <= 0)
+		return h8;
+
+	// Forks share memory pages with h8, so this copies a few hundred bytes
+	// plus whatever pages the speculative frames write to
+	delete ahead;
+	ahead = h8.fork();
+	for (int frame = 0; frame < frames; ++frame)
+		ahead->run_frame(cycles_per_frame);
+	return *ahead;
+}
+
+template class RunAhead<hadron8>;
+template class RunAhead<schip8>;
+template class RunAhead<xochip8>;
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+
+template <class Variant> class basic_hadron8;
+
+// Hides the frames a game takes to react to input. Every host frame the
+// machine runs its frame as usual, then a throwaway fork of it runs
+// `frames` more frames with the same keys held, and the fork's screen is
+// the one presented. Input reaches the screen that many frames sooner, for
+// (frames + 1) times the emulation work. The fork is muted, so audio still
+// follows the real machine.
+//
+// Instantiated for each variant of the core (hadron8, schip8, xochip8).
+
+template <class Machine>
+class RunAhead
+{
+public:
+	RunAhead(int frames, int cycles_per_frame);
+	~RunAhead();
+
+	// Emulates one frame of h8 and returns the machine whose screen to
+	// present. Valid until the next call.
+	const Machine& frame(Machine& h8);
+
+	inline int get_frames() const { return frames; }
+private:
+	int frames;
+	uint64_t cycles_per_frame;
+	Machine* ahead;
+
+	RunAhead(const RunAhead&) = delete;
+	RunAhead& operator=(const RunAhead&) = delete;
+};
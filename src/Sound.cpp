@@ -1,19 +1,126 @@
 #include "Sound.h"
+#include "beep_wav.h"
+
+#include <cmath>
+#include <cstring>
 
 Sound::~Sound()
 {
-	SDL_CloseAudioDevice(device);
+	if (device != 0)
+	{
+		SDL_CloseAudioDevice(device);
+		SDL_QuitSubSystem(SDL_INIT_AUDIO);
+	}
+	if (pattern_device != 0)
+	{
+		SDL_CloseAudioDevice(pattern_device);
+		SDL_QuitSubSystem(SDL_INIT_AUDIO);
+	}
 	SDL_FreeWAV(wav_buffer);
 }
 
 void Sound::load(const char* filename)
 {
+	SDL_FreeWAV(wav_buffer);
+	wav_buffer = nullptr;
 	SDL_LoadWAV(filename, &wav_spec, &wav_buffer, &wav_length);
+}
+
+/*
+	Audio is brought up on the first beep, so runs that never
+	sound the buzzer never pay for opening an audio device.
+*/
+void Sound::open()
+{
+	opened = true;
+	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+		std::cout << "SDL_InitSubSystem Error: " << SDL_GetError() << std::endl;
+		return;
+	}
+
+	// Fall back to the buzzer embedded in the binary
+	if (wav_buffer == nullptr)
+		SDL_LoadWAV_RW(SDL_RWFromConstMem(beep_wav, beep_wav_len), 1, &wav_spec, &wav_buffer, &wav_length);
+
 	device = SDL_OpenAudioDevice(NULL, 0, &wav_spec, NULL, 0);
+	if (device == 0)
+		SDL_QuitSubSystem(SDL_INIT_AUDIO);
 }
 
 void Sound::play()
 {
+	if (!opened)
+		open();
+	if (device == 0)
+		return;
+
 	SDL_QueueAudio(device, wav_buffer, wav_length);
 	SDL_PauseAudioDevice(device, 0);
-}
\ No newline at end of file
+}
+
+/*
+	Like the buzzer's, the pattern device is opened on first use. It is
+	8-bit mono, so each pattern bit is one of two sample levels.
+*/
+void Sound::open_pattern()
+{
+	pattern_opened = true;
+	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+		std::cout << "SDL_InitSubSystem Error: " << SDL_GetError() << std::endl;
+		return;
+	}
+
+	SDL_AudioSpec want;
+	memset(&want, 0, sizeof(want));
+	want.freq = 44100;
+	want.format = AUDIO_U8;
+	want.channels = 1;
+	want.samples = 512;
+	want.callback = fill_pattern;
+	want.userdata = this;
+	pattern_device = SDL_OpenAudioDevice(NULL, 0, &want, &pattern_spec, 0);
+	if (pattern_device == 0)
+		SDL_QuitSubSystem(SDL_INIT_AUDIO);
+}
+
+/*
+	Runs on SDL's audio thread, with the device locked.
+*/
+void SDLCALL Sound::fill_pattern(void* sound, Uint8* stream, int length)
+{
+	Sound& s = *(Sound*)sound;
+	for (int i = 0; i < length; ++i)
+	{
+		int bit = (int)s.pattern_phase;
+		stream[i] = (s.pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? 0xc0 : 0x40;
+		s.pattern_phase += s.pattern_step;
+		if (s.pattern_phase >= 128.0)
+			s.pattern_phase -= 128.0;
+	}
+}
+
+void Sound::play_pattern(const uint8_t pattern[16], uint8_t pitch)
+{
+	if (!pattern_opened)
+		open_pattern();
+	if (pattern_device == 0)
+		return;
+
+	SDL_LockAudioDevice(pattern_device);
+	memcpy(this->pattern, pattern, sizeof(this->pattern));
+	pattern_step = 4000.0 * pow(2.0, (pitch - 64) / 48.0) / pattern_spec.freq;
+	if (!pattern_playing)
+		pattern_phase = 0.0;
+	SDL_UnlockAudioDevice(pattern_device);
+
+	if (!pattern_playing)
+		SDL_PauseAudioDevice(pattern_device, 0);
+	pattern_playing = true;
+}
+
+void Sound::stop()
+{
+	if (pattern_device != 0 && pattern_playing)
+		SDL_PauseAudioDevice(pattern_device, 1);
+	pattern_playing = false;
+}
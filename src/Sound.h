@@ -9,10 +9,29 @@ public:
     ~Sound();
     void load(const char*);
     void play();
+    // XO-CHIP: loops the 128 bit audio pattern, one bit per sample at
+    // 4000 * 2^((pitch - 64) / 48) Hz, until stop(). Called again while
+    // playing, it goes on with the new pattern and pitch without a gap.
+    void play_pattern(const uint8_t pattern[16], uint8_t pitch);
+    void stop();
 
 private:
+    void open();
+    void open_pattern();
+    static void SDLCALL fill_pattern(void* sound, Uint8* stream, int length);
+
     SDL_AudioSpec wav_spec;
-    Uint32 wav_length;
+    Uint32 wav_length = 0;
     Uint8* wav_buffer = nullptr;
-    SDL_AudioDeviceID device;
+    SDL_AudioDeviceID device = 0;
+    bool opened = false;
+
+    // The pattern plays on a device of its own, fed by fill_pattern()
+    SDL_AudioDeviceID pattern_device = 0;
+    SDL_AudioSpec pattern_spec;
+    bool pattern_opened = false;
+    bool pattern_playing = false;
+    Uint8 pattern[16] = { 0 };
+    double pattern_step = 0.0;  // Pattern bits per output sample
+    double pattern_phase = 0.0; // Bit being played, with the fraction passed
 };
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "Telemetry.h"
+
+#include <algorithm>
+#include <cstring>
+
+// 3x5 pixel glyphs for the overlay, one row of three bits per byte
+static const char glyph_chars[] = " 0123456789./-ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+static const uint8_t glyphs[][5] =
+{
+	{ 0, 0, 0, 0, 0 },                // space
+	{ 07, 05, 05, 05, 07 },           // 0
+	{ 02, 06, 02, 02, 07 },           // 1
+	{ 07, 01, 07, 04, 07 },           // 2
+	{ 07, 01, 07, 01, 07 },           // 3
+	{ 05, 05, 07, 01, 01 },           // 4
+	{ 07, 04, 07, 01, 07 },           // 5
+	{ 07, 04, 07, 05, 07 },           // 6
+	{ 07, 01, 01, 02, 02 },           // 7
+	{ 07, 05, 07, 05, 07 },           // 8
+	{ 07, 05, 07, 01, 07 },           // 9
+	{ 0, 0, 0, 0, 02 },               // .
+	{ 01, 01, 02, 04, 04 },           // /
+	{ 0, 0, 07, 0, 0 },               // -
+	{ 02, 05, 07, 05, 05 },           // A
+	{ 06, 05, 06, 05, 06 },           // B
+	{ 03, 04, 04, 04, 03 },           // C
+	{ 06, 05, 05, 05, 06 },           // D
+	{ 07, 04, 06, 04, 07 },           // E
+	{ 07, 04, 06, 04, 04 },           // F
+	{ 03, 04, 05, 05, 03 },           // G
+	{ 05, 05, 07, 05, 05 },           // H
+	{ 07, 02, 02, 02, 07 },           // I
+	{ 01, 01, 01, 05, 02 },           // J
+	{ 05, 05, 06, 05, 05 },           // K
+	{ 04, 04, 04, 04, 07 },           // L
+	{ 05, 07, 07, 05, 05 },           // M
+	{ 06, 05, 05, 05, 05 },           // N
+	{ 02, 05, 05, 05, 02 },           // O
+	{ 06, 05, 06, 04, 04 },           // P
+	{ 02, 05, 05, 06, 03 },           // Q
+	{ 06, 05, 06, 05, 05 },           // R
+	{ 03, 04, 02, 01, 06 },           // S
+	{ 07, 02, 02, 02, 02 },           // T
+	{ 05, 05, 05, 05, 07 },           // U
+	{ 05, 05, 05, 05, 02 },           // V
+	{ 05, 05, 07, 07, 05 },           // W
+	{ 05, 05, 02, 05, 05 },           // X
+	{ 05, 05, 02, 02, 02 },           // Y
+	{ 07, 01, 02, 04, 07 }            // Z
+};
+
+// Nanoseconds, saturating at about 4 s
+static inline uint32_t to_ns(Telemetry::clock::duration d)
+{
+	long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+	return ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+Telemetry::Telemetry()
+	: input_pending(false), hud(false), last_cycles(0), frames(0), log(nullptr), latencies(0), frame_present_ns(0)
+{
+	memset(frame_ns, 0, sizeof(frame_ns));
+	memset(present_ns, 0, sizeof(present_ns));
+	memset(instructions, 0, sizeof(instructions));
+	memset(latency_ns, 0, sizeof(latency_ns));
+	frame_start = log_start = clock::now();
+}
+
+Telemetry::~Telemetry()
+{
+	if (log != nullptr)
+		fclose(log);
+}
+
+bool Telemetry::open_log(const char* filename)
+{
+	log = fopen(filename, "w");
+	if (log == nullptr)
+	{
+		fprintf(stderr, "Cannot write %s\n", filename);
+		return false;
+	}
+	log_start = clock::now();
+	return true;
+}
+
+void Telemetry::begin_frame()
+{
+	frame_start = clock::now();
+}
+
+void Telemetry::end_frame(uint64_t cycles)
+{
+	int i = (int)(frames % window);
+	frame_ns[i] = to_ns(clock::now() - frame_start);
+	present_ns[i] = frame_present_ns;
+	instructions[i] = (uint32_t)(cycles - last_cycles);
+	last_cycles = cycles;
+	frame_present_ns = 0;
+	++frames;
+
+	if (log != nullptr && frames % window == 0)
+		write_log();
+}
+
+void Telemetry::input_event(clock::time_point when)
+{
+	if (input_pending)
+		return;
+	pending_input = when;
+	input_pending = true;
+}
+
+void Telemetry::presented(clock::time_point start, clock::time_point end)
+{
+	frame_present_ns += to_ns(end - start);
+	if (input_pending)
+	{
+		latency_ns[latencies % latency_window] = to_ns(end - pending_input);
+		++latencies;
+		input_pending = false;
+	}
+}
+
+/*
+	p50, p99 and the maximum of count samples, in milliseconds.
+*/
+void Telemetry::percentiles(const uint32_t* samples, int count, double* out) const
+{
+	if (count == 0)
+	{
+		out[0] = out[1] = out[2] = 0.0;
+		return;
+	}
+	memcpy(sorted, samples, count * sizeof(uint32_t));
+	int p99 = (count * 99 + 99) / 100 - 1;
+	std::nth_element(sorted, sorted + (count - 1) / 2, sorted + count);
+	out[0] = sorted[(count - 1) / 2] / 1e6;
+	std::nth_element(sorted, sorted + p99, sorted + count);
+	out[1] = sorted[p99] / 1e6;
+	out[2] = *std::max_element(sorted, sorted + count) / 1e6;
+}
+
+Telemetry::Stats Telemetry::get_stats() const
+{
+	Stats stats;
+	stats.frames = (int)std::min<uint64_t>(frames, window);
+	stats.latency_samples = (int)std::min<uint64_t>(latencies, latency_window);
+
+	uint64_t total_ns = 0, total_instructions = 0;
+	for (int i = 0; i < stats.frames; ++i)
+	{
+		total_ns += frame_ns[i];
+		total_instructions += instructions[i];
+	}
+	stats.fps = total_ns == 0 ? 0.0 : stats.frames * 1e9 / total_ns;
+	stats.instructions = stats.frames == 0 ? 0.0 : (double)total_instructions / stats.frames;
+
+	percentiles(frame_ns, stats.frames, stats.frame_ms);
+	percentiles(present_ns, stats.frames, stats.present_ms);
+	percentiles(latency_ns, stats.latency_samples, stats.latency_ms);
+	return stats;
+}
+
+void Telemetry::write_log()
+{
+	Stats s = get_stats();
+	double t = std::chrono::duration<double>(clock::now() - log_start).count();
+	fprintf(log, "%.1f s: %.1f fps, %.1f instructions/frame, frame ms p50 %.3f p99 %.3f max %.3f, "
+		"present ms p50 %.3f p99 %.3f max %.3f, input latency ms p50 %.3f p99 %.3f max %.3f (%d events)\n",
+		t, s.fps, s.instructions, s.frame_ms[0], s.frame_ms[1], s.frame_ms[2],
+		s.present_ms[0], s.present_ms[1], s.present_ms[2],
+		s.latency_ms[0], s.latency_ms[1], s.latency_ms[2], s.latency_samples);
+	fflush(log);
+}
+
+static void draw_text(uint32_t* pixels, int width, int height, int x, int y, const char* text)
+{
+	const int scale = 2;
+	for (; *text != 0; ++text, x += 4 * scale)
+	{
+		const char* found = strchr(glyph_chars, *text);
+		if (found == nullptr || *found == 0)
+			continue;
+		const uint8_t* glyph = glyphs[found - glyph_chars];
+		for (int row = 0; row < 5 * scale; ++row)
+			for (int column = 0; column < 3 * scale; ++column)
+			{
+				int px = x + column, py = y + row;
+				if (px < width && py < height && ((glyph[row / scale] >> (2 - column / scale)) & 1))
+					pixels[py * width + px] = 0x00ff00;
+			}
+	}
+}
+
+void Telemetry::draw_hud(uint32_t* pixels, int width, int height) const
+{
+	Stats s = get_stats();
+	char lines[5][40];
+	snprintf(lines[0], sizeof(lines[0]), "FPS %.1f  INSTR %.0f", s.fps, s.instructions);
+	snprintf(lines[1], sizeof(lines[1]), "MS       P50   P99   MAX");
+	snprintf(lines[2], sizeof(lines[2]), "FRAME %6.2f%6.2f%6.2f", s.frame_ms[0], s.frame_ms[1], s.frame_ms[2]);
+	snprintf(lines[3], sizeof(lines[3]), "VSYNC %6.2f%6.2f%6.2f", s.present_ms[0], s.present_ms[1], s.present_ms[2]);
+	snprintf(lines[4], sizeof(lines[4]), "INPUT %6.2f%6.2f%6.2f", s.latency_ms[0], s.latency_ms[1], s.latency_ms[2]);
+
+	// Dim the game behind the text
+	const int box_width = std::min(width, 4 + 24 * 8), box_height = std::min(height, 4 + 5 * 12);
+	for (int y = 0; y < box_height; ++y)
+		for (int x = 0; x < box_width; ++x)
+			pixels[y * width + x] = (pixels[y * width + x] >> 2) & 0x3f3f3f;
+
+	for (int i = 0; i < 5; ++i)
+		draw_text(pixels, width, height, 4, 4 + i * 12, lines[i]);
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// Frontend performance counters: instructions emulated per frame, host
+// frame time, time spent presenting (mostly the vsync wait) and the time
+// from a key event to the next present. The last `window` frames are kept
+// in fixed rings, so recording never allocates; percentiles are taken
+// over them. They can be shown as an overlay on the emulator window
+// (toggled with F1) and written to a log file once per window.
+
+class Telemetry
+{
+public:
+	typedef std::chrono::steady_clock clock;
+
+	// Frames the statistics cover, 2 s at 60 Hz
+	static const int window = 120;
+	// Key event to present latencies kept
+	static const int latency_window = 32;
+
+	struct Stats
+	{
+		int frames;            // Samples the figures below are taken from
+		double fps;
+		double instructions;   // Per frame, on average
+		double frame_ms[3];    // p50, p99, max
+		double present_ms[3];
+		int latency_samples;
+		double latency_ms[3];
+	};
+
+	Telemetry();
+	~Telemetry();
+
+	// Writes a line of statistics to filename every window frames
+	bool open_log(const char* filename);
+
+	// Around one iteration of the frontend loop: emulation, present and
+	// the wait for the next frame. cycles is the machine's instruction count.
+	void begin_frame();
+	void end_frame(uint64_t cycles);
+	// A key went down or up at when; the next present completes its latency
+	void input_event(clock::time_point when);
+	// The frame was handed to the display between start and end
+	void presented(clock::time_point start, clock::time_point end);
+
+	inline void toggle_hud() { hud = !hud; }
+	inline void set_hud(bool visible) { hud = visible; }
+	inline bool is_hud_visible() const { return hud; }
+	// Draws the overlay into an ARGB8888 frame of width x height pixels
+	void draw_hud(uint32_t* pixels, int width, int height) const;
+
+	Stats get_stats() const;
+private:
+	clock::time_point frame_start;
+	clock::time_point pending_input; // Oldest key event not presented yet
+	bool input_pending;
+	bool hud;
+	uint64_t last_cycles;
+	uint64_t frames;
+	clock::time_point log_start;
+	FILE* log;
+
+	// Nanoseconds, indexed by frame (or event) number modulo their size
+	uint32_t frame_ns[window];
+	uint32_t present_ns[window];
+	uint32_t instructions[window];
+	uint32_t latency_ns[latency_window];
+	uint64_t latencies;
+	uint32_t frame_present_ns; // Presents of the current frame so far
+
+	// Scratch space for percentiles
+	mutable uint32_t sorted[window];
+
+	void percentiles(const uint32_t* samples, int count, double* out) const;
+	void write_log();
+
+	Telemetry(const Telemetry&) = delete;
+	Telemetry& operator=(const Telemetry&) = delete;
+};
@@ -0,0 +1,96 @@
+#include "Trace.h"
+
+#include <chrono>
+
+Trace::Trace(const char* filename, size_t capacity)
+	: ring(nullptr), capacity(2), file(nullptr), head(0), tail_cache(0), dropped(0), gap(0), tail(0), stop(false)
+{
+	// The ring is indexed with a mask, so round the capacity up to a power of
+	// two, and at least one record plus a gap record
+	while (this->capacity < capacity)
+		this->capacity <<= 1;
+
+	file = fopen(filename, "wb");
+	if (file == nullptr)
+	{
+		fprintf(stderr, "Trace error: cannot open %s\n", filename);
+		return;
+	}
+
+	TraceHeader header = { { 'H', '8', 'T', 'R' }, 2, sizeof(TraceRecord) };
+	fwrite(&header, sizeof(header), 1, file);
+
+	ring = new TraceRecord[this->capacity];
+	writer = std::thread(&Trace::spill, this);
+}
+
+Trace::~Trace()
+{
+	if (file == nullptr)
+		return;
+
+	stop.store(true, std::memory_order_release);
+	writer.join();
+
+	// Records dropped at the very end have no later record to carry their gap
+	if (gap != 0)
+	{
+		TraceRecord r;
+		write_gap(r);
+		fwrite(&r, sizeof(r), 1, file);
+	}
+	fclose(file);
+	delete[] ring;
+
+	if (dropped != 0)
+		fprintf(stderr, "Trace: %llu records dropped\n", (unsigned long long)dropped);
+}
+
+/*
+	Fills in a gap record for the records dropped since the last one written.
+*/
+void Trace::write_gap(TraceRecord& r)
+{
+	r.pc = (uint16_t)gap;
+	r.opcode = (uint16_t)(gap >> 16);
+	r.I = (uint16_t)(gap >> 32);
+	r.reg = trace_gap;
+	r.value = 0;
+	gap = 0;
+}
+
+/*
+	Writes out everything the producer has published so far.
+	Returns false if the ring was empty.
+*/
+bool Trace::drain()
+{
+	size_t t = tail.load(std::memory_order_relaxed);
+	size_t h = head.load(std::memory_order_acquire);
+	if (h == t)
+		return false;
+
+	while (t != h)
+	{
+		// Stop at the physical end of the ring so each write is contiguous
+		size_t start = t & (capacity - 1);
+		size_t count = h - t;
+		if (count > capacity - start)
+			count = capacity - start;
+
+		fwrite(&ring[start], sizeof(TraceRecord), count, file);
+		t += count;
+		tail.store(t, std::memory_order_release);
+	}
+	return true;
+}
+
+void Trace::spill()
+{
+	while (!stop.load(std::memory_order_acquire))
+	{
+		if (!drain())
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	drain();
+}
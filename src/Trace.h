@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+// Binary execution trace. The emulator thread appends fixed-size records
+// to a single-producer ring; a background thread spills the ring to disk.
+// When the writer falls behind, records are dropped (and counted) rather
+// than stalling emulation, and a gap record in the file marks where.
+
+struct TraceRecord
+{
+	uint16_t pc;
+	uint16_t opcode;
+	uint16_t I;
+	uint8_t reg;   // Register the instruction wrote its result to, or trace_no_register
+	uint8_t value; // Its value after the instruction executed
+};
+static_assert(sizeof(TraceRecord) == 8, "trace records are written to disk as-is");
+
+// reg of an instruction that writes no register (jumps, skips, stores, ...).
+// 8XY4 to 8XYE also set VF and FX65 loads V0 up to the VX recorded; only
+// the result register is kept.
+static const uint8_t trace_no_register = 0xFF;
+// reg of a gap record, which stands for records that were dropped: pc,
+// opcode and I hold how many, low word first
+static const uint8_t trace_gap = 0xFE;
+
+inline uint64_t trace_gap_length(const TraceRecord& r)
+{
+	return r.pc | (uint64_t)r.opcode << 16 | (uint64_t)r.I << 32;
+}
+
+// File layout: TraceHeader followed by TraceRecords in execution order
+struct TraceHeader
+{
+	char magic[4]; // "H8TR"
+	uint16_t version; // 2 since gap records and written registers
+	uint16_t record_size;
+};
+
+class Trace
+{
+public:
+	Trace(const char* filename, size_t capacity = 1 << 20);
+	~Trace();
+
+	inline bool is_open() const { return file != nullptr; }
+	inline uint64_t get_dropped() const { return dropped; }
+
+	inline void record(uint16_t pc, uint16_t opcode, uint16_t I, uint8_t reg, uint8_t value)
+	{
+		// After a drop the next record needs room for the gap record too
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t needed = gap != 0 ? 2 : 1;
+		if (h + needed - tail_cache > capacity)
+		{
+			tail_cache = tail.load(std::memory_order_acquire);
+			if (h + needed - tail_cache > capacity)
+			{
+				++dropped;
+				++gap;
+				return;
+			}
+		}
+		if (gap != 0)
+			write_gap(ring[h++ & (capacity - 1)]);
+
+		TraceRecord& r = ring[h & (capacity - 1)];
+		r.pc = pc;
+		r.opcode = opcode;
+		r.I = I;
+		r.reg = reg;
+		r.value = value;
+		head.store(h + 1, std::memory_order_release);
+	}
+private:
+	TraceRecord* ring;
+	size_t capacity;
+	FILE* file;
+
+	// Producer side
+	alignas(64) std::atomic<size_t> head;
+	size_t tail_cache;
+	uint64_t dropped;
+	uint64_t gap;     // Records dropped since the last one written
+
+	// Consumer side
+	alignas(64) std::atomic<size_t> tail;
+	std::atomic<bool> stop;
+	std::thread writer;
+
+	void spill();
+	bool drain();
+	void write_gap(TraceRecord& r);
+
+	Trace(const Trace&) = delete;
+	Trace& operator=(const Trace&) = delete;
+};
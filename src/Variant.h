@@ -0,0 +1,43 @@
+#pragma once
+
+// The machines the core is compiled for. Each one is a separate
+// instantiation of basic_hadron8 with its own decode table, memory size and
+// framebuffer, so features of one never cost the others a runtime check.
+
+// The original CHIP-8: 4 KB, 64x32, one plane
+struct chip8_variant
+{
+	static constexpr const char* name = "CHIP-8";
+	static const int memory_size = 4096;
+	static const int width = 64;
+	static const int height = 32;
+	static const int planes = 1;
+	static const bool schip = false;
+	static const bool xochip = false;
+};
+
+// SUPER-CHIP 1.1: 128x64 hi-res mode, scrolling, 16x16 sprites, big font,
+// RPL flags and an exit instruction
+struct schip_variant
+{
+	static constexpr const char* name = "SUPER-CHIP";
+	static const int memory_size = 4096;
+	static const int width = 128;
+	static const int height = 64;
+	static const int planes = 1;
+	static const bool schip = true;
+	static const bool xochip = false;
+};
+
+// XO-CHIP: SUPER-CHIP plus 64 KB of memory, two bitplanes, register range
+// save/load, long I loads and a programmable audio pattern
+struct xochip_variant
+{
+	static constexpr const char* name = "XO-CHIP";
+	static const int memory_size = 65536;
+	static const int width = 128;
+	static const int height = 64;
+	static const int planes = 2;
+	static const bool schip = true;
+	static const bool xochip = true;
+};
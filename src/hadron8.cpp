@@ -1,77 +1,201 @@
 #include "hadron8.h"
+#include "Analysis.h"
+#include "Pool.h"
+#include "fontset.h"
+
+#include <cstring>
+#include <vector>
 
 // 0x000 - 0x1FF - Chip 8 interpreter (contains font set in emu)
 // 0x050 - 0x0A0 - Used for the built in 4x5 pixel font set(0 - F)
-// 0x200 - 0xFFF - Program ROM and work RAM
+// 0x200 - 0xFFF - Program ROM and work RAM (0xFFFF in XO-CHIP)
+
+// Memory of a freshly reset machine: zeroes and the font sets
+template <class Variant>
+static std::vector<uint8_t> boot_image()
+{
+	std::vector<uint8_t> image(Variant::memory_size, 0);
+	for (int i = 0; i < 80; ++i)
+		image[i] = chip8_fontset[i];
+	if (Variant::schip)
+		for (int i = 0; i < 160; ++i)
+			image[80 + i] = schip_fontset[i];
+	return image;
+}
+
+// Memory image with only the font set loaded, shared by every machine
+// until a game is loaded
+template <class Variant>
+static const std::shared_ptr<const Rom>& blank_rom()
+{
+	static std::shared_ptr<const Rom> rom = []
+	{
+		std::vector<uint8_t> image = boot_image<Variant>();
+		return std::make_shared<const Rom>(image.data(), image.size(), 0);
+	}();
+	return rom;
+}
 
-hadron8::hadron8()
-	: pc(0x200), opcode(0), I(0), sp(0), delay_timer(0), sound_timer(0), inc(1), draw(1), exit_emulation(0),
-		renderer(nullptr), window(nullptr), texture(nullptr), pixels(nullptr),
-		V{ 0 }, stack{ 0 }, gfx{ 0 }, memory{ 0 }, key{ 0 },
-		beep_filename(".\\sound\\beep.wav")
+template <class Variant>
+basic_hadron8<Variant>::basic_hadron8(bool headless)
+	: headless(headless), pc(0x200), opcode(0), I(0), sp(0), delay_timer(0), sound_timer(0), cycles(0), invalid_opcodes(0), rng(1), muted(false), fusion(true), flat_decode(false),
+		native(nullptr), inc(1), draw(1), exit_emulation(0), hires(false), plane_mask(1), pitch(64),
+		renderer(nullptr), window(nullptr), texture(nullptr), pixels(nullptr), trace(nullptr), coverage(nullptr), telemetry(nullptr),
+		V{ 0 }, stack{ 0 }, gfx{ 0 }, memory{ nullptr }, key{ 0 }, pattern{ 0 }, rpl{ 0 }, key_wait(0), wait_held(0),
+		input_head(0), input_count(0), last_poll(0), keymap(nullptr), input_log(nullptr)
 {
 	// Clear display
-	for (int i = 0; i < 2048; ++i)
-		gfx[i] = 0;
+	memset(gfx, 0, sizeof(gfx));
 
 	// Clear stack
-	for (int i = 0; i < 16; ++i)
+	for (int i = 0; i < stack_slots; ++i)
 		stack[i] = 0;
 
 	for (int i = 0; i < 16; ++i)
 		key[i] = V[i] = 0;
 
-	// Clear memory
-	for (int i = 0; i < 4096; ++i)
-		memory[i] = 0;
-
-	/*
-					EXAMPLE
-
-		DEC   HEX    BIN         RESULT
-		240   0xF0   1111 0000    ****     
-		144   0x90   1001 0000    *  *      
-		144   0x90   1001 0000    *  *      
-		144   0x90   1001 0000    *  *      
-		240   0xF0   1111 0000    ****
-		
-		240   0xF0   1111 0000    ****
-		 16   0x10   0001 0000       *
-		 32   0x20   0010 0000      *
-		 64   0x40   0100 0000     *
-		 64   0x40   0100 0000     *
-
-		240   0xF0   1111 0000    ****
-		 16   0x10   0001 0000       *
-		 32   0xF0   0010 0000    ****
-		 64   0x10   0100 0000    *    
-		 64   0xF0   0100 0000    ****
-	*/
-	uint8_t chip8_fontset[80] =
-	{
-	  0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-	  0x20, 0x60, 0x20, 0x20, 0x70, // 1
-	  0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-	  0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-	  0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-	  0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-	  0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-	  0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-	  0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-	  0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-	  0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-	  0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-	  0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-	  0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-	  0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-	  0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+	set_seed((uint32_t)time(NULL));
+	boot(blank_rom<Variant>());
+}
+
+/*
+	Copies the architectural state of another machine. Memory pages and the
+	ROM image are shared copy-on-write, so this costs a few hundred bytes
+	until either machine writes to memory. The copy is always headless, muted,
+	untraced, does not collect coverage or telemetry and has no key changes
+	queued.
+*/
+template <class Variant>
+basic_hadron8<Variant>::basic_hadron8(const basic_hadron8& other)
+	: headless(true), muted(true), fusion(other.fusion), flat_decode(other.flat_decode), native(other.native),
+		window(nullptr), renderer(nullptr), texture(nullptr), pixels(nullptr), trace(nullptr), coverage(nullptr), telemetry(nullptr),
+		input_head(0), input_count(0), last_poll(0), keymap(nullptr), input_log(nullptr)
+{
+	copy_state(other);
+}
+
+template <class Variant>
+basic_hadron8<Variant>* basic_hadron8<Variant>::fork() const
+{
+	return new basic_hadron8(*this);
+}
+
+/*
+	Rewinds this machine to a snapshot taken from it with fork(). Its window,
+	sound and settings stay as they are; the screen is presented again on the
+	next draw_gfx() since it may differ from what was last shown.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::restore(const basic_hadron8& snapshot)
+{
+	for (int i = 0; i < page_count; ++i)
+		Page::release(memory[i]);
+	copy_state(snapshot);
+	draw = 1;
+}
+
+template <class Variant>
+void basic_hadron8<Variant>::copy_state(const basic_hadron8& other)
+{
+	sp = other.sp;
+	opcode = other.opcode;
+	rom = other.rom;
+	I = other.I;
+	pc = other.pc;
+	exit_emulation = other.exit_emulation;
+	inc = other.inc;
+	draw = other.draw;
+	delay_timer = other.delay_timer;
+	sound_timer = other.sound_timer;
+	cycles = other.cycles;
+	invalid_opcodes = other.invalid_opcodes;
+	rng = other.rng;
+	hires = other.hires;
+	plane_mask = other.plane_mask;
+	pitch = other.pitch;
+
+	memcpy(pattern, other.pattern, sizeof(pattern));
+	memcpy(rpl, other.rpl, sizeof(rpl));
+	memcpy(stack, other.stack, sizeof(stack));
+	memcpy(V, other.V, sizeof(V));
+	memcpy(gfx, other.gfx, sizeof(gfx));
+	memcpy(key, other.key, sizeof(key));
+	key_wait = other.key_wait;
+	wait_held = other.wait_held;
+	for (int i = 0; i < page_count; ++i)
+		memory[i] = other.memory[i]->retain();
+	for (int i = page_count; i < page_slots; ++i)
+		memory[i] = memory[i % page_count];
+}
+
+/*
+	Hash of the machine state: registers, timers, stack, screen, memory and
+	any FX0A wait. The keys are input and left out, both those held and the
+	changes still queued: netplay, for one, keeps only the local player's
+	keys there between frames. Two machines with equal hashes continue the
+	same way given the same keys.
+*/
+template <class Variant>
+uint64_t basic_hadron8<Variant>::state_hash() const
+{
+	uint8_t registers[] = {
+		(uint8_t)I, (uint8_t)(I >> 8), (uint8_t)pc, (uint8_t)(pc >> 8), sp, inc, delay_timer, sound_timer,
+		(uint8_t)rng, (uint8_t)(rng >> 8), (uint8_t)(rng >> 16), (uint8_t)(rng >> 24),
+		key_wait, (uint8_t)wait_held, (uint8_t)(wait_held >> 8)
 	};
+	uint64_t hash = rom_hash(registers, sizeof(registers));
+	hash = rom_hash(V, sizeof(V), hash);
+	hash = rom_hash((const uint8_t*)stack, sizeof(stack), hash);
+	hash = rom_hash((const uint8_t*)gfx, sizeof(gfx), hash);
+	if (Variant::schip)
+	{
+		uint8_t modes[] = { hires, plane_mask, pitch };
+		hash = rom_hash(modes, sizeof(modes), hash);
+		hash = rom_hash(pattern, sizeof(pattern), hash);
+		hash = rom_hash(rpl, sizeof(rpl), hash);
+	}
+	for (int i = 0; i < page_count; ++i)
+		hash = rom_hash(memory[i]->data, Page::size, hash);
+	return hash;
+}
 
-	for (int i = 0; i < 80; ++i)
-		memory[i] = chip8_fontset[i];
-	
-	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
-		std::cout << "SDL_Init Error: " << SDL_GetError() << std::endl;
+template <class Variant>
+void* basic_hadron8<Variant>::operator new(size_t)
+{
+	return Pool<sizeof(basic_hadron8)>::allocate();
+}
+
+template <class Variant>
+void basic_hadron8<Variant>::operator delete(void* p)
+{
+	Pool<sizeof(basic_hadron8)>::release(p);
+}
+
+template <class Variant>
+basic_hadron8<Variant>::~basic_hadron8()
+{
+	for (int i = 0; i < page_count; ++i)
+		Page::release(memory[i]);
+
+	if (window == nullptr)
+		return;
+
+	delete[] pixels;
+	SDL_DestroyTexture(texture);
+	SDL_DestroyRenderer(renderer);
+	SDL_DestroyWindow(window);
+	SDL_QuitSubSystem(SDL_INIT_VIDEO);
+}
+
+/*
+	The window is created on first use rather than in the constructor,
+	so headless runs never touch the video subsystem.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::init_video()
+{
+	if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+		std::cout << "SDL_InitSubSystem Error: " << SDL_GetError() << std::endl;
 		exit(1);
 	}
 
@@ -99,94 +223,272 @@ hadron8::hadron8()
 
 	pixels = new Uint32[640 * 320];
 	memset(pixels, 0, 640 * 320 * sizeof(Uint32));
+}
+
+/*
+	Points every memory page at the ROM image, dropping any pages
+	this machine had written to.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::boot(const std::shared_ptr<const Rom>& image)
+{
+	for (int i = 0; i < page_count; ++i)
+	{
+		if (memory[i] != nullptr)
+			Page::release(memory[i]);
+		memory[i] = image->page(i)->retain();
+	}
+	for (int i = page_count; i < page_slots; ++i)
+		memory[i] = memory[i % page_count];
 
-	beep_sound.load(beep_filename);
+	// Native code only fits the ROM it was compiled from
+	if (rom != nullptr && rom->get_hash() != image->get_hash())
+		native = nullptr;
+	rom = image;
 }
 
-hadron8::~hadron8()
+template <class Variant>
+void basic_hadron8<Variant>::disp_clear()
 {
-	SDL_DestroyWindow(window);
-	SDL_Quit();
+	for (int p = 0; p < Variant::planes; ++p)
+		if ((selected_planes() >> p) & 1)
+			memset(gfx[p], 0, sizeof(gfx[p]));
+	draw = 1;
 }
 
-void hadron8::disp_clear()
+/*
+	Moves the selected planes dx pixels right and dy pixels down, in pixels
+	of the current mode. What scrolls in is blank.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::scroll(int dx, int dy)
 {
-	for (int i = 0; i < 64 * 32; ++i)
-		gfx[i] = 0;
+	const int width = screen_width();
+	const int height = screen_height();
+	for (int p = 0; p < Variant::planes; ++p)
+	{
+		if (((selected_planes() >> p) & 1) == 0)
+			continue;
+
+		uint64_t old[screen_words];
+		memcpy(old, gfx[p], sizeof(old));
+		memset(gfx[p], 0, sizeof(gfx[p]));
+		for (int y = 0; y < height; ++y)
+		{
+			int from_y = y - dy;
+			if (from_y < 0 || from_y >= height)
+				continue;
+			for (int x = 0; x < width; ++x)
+			{
+				int from_x = x - dx;
+				if (from_x < 0 || from_x >= width)
+					continue;
+				int from = from_y * width + from_x;
+				int to = y * width + x;
+				if ((old[from >> 6] >> (63 - (from & 63))) & 1)
+					gfx[p][to >> 6] |= 1ull << (63 - (to & 63));
+			}
+		}
+	}
 	draw = 1;
 }
 
-void hadron8::reg_dump(int x)
+template <class Variant>
+void basic_hadron8<Variant>::reg_dump(int x)
 {
+	if (coverage != nullptr)
+		coverage->written(I, x + 1);
 	for (int i = 0; i <= x; ++i)
-		memory[I + i] = V[i];
+		mem_write(I + i, V[i]);
 }
 
-void hadron8::reg_load(int x)
+template <class Variant>
+void basic_hadron8<Variant>::reg_load(int x)
 {
+	if (coverage != nullptr)
+		coverage->read(I, x + 1);
 	for (int i = 0; i <= x; ++i)
-		V[i] = memory[I + i];
+		V[i] = mem_read(I + i);
+}
+
+/*
+	Gives the page holding addr a private copy, in every slot that mirrors it.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::unshare_page(uint16_t addr)
+{
+	int first = (addr >> Page::bits) & (page_count - 1);
+	Page* copy = Page::unshare(memory[first]);
+	for (int i = first; i < page_slots; i += page_count)
+		memory[i] = copy;
+}
+
+/*
+	An out-of-range access under HADRON8_BOUNDS_TRAP. The instruction still
+	completes with the index wrapped, then the machine stops: run() returns
+	and executes nothing more.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::trap(const char* what, unsigned index)
+{
+	if (exit_emulation == 0)
+		fprintf(stderr, "Out of range %s 0x%X at 0x%03X (opcode 0x%04X)\n", what, index, pc, opcode);
+	exit_emulation = 1;
 }
 
-void hadron8::beep()
+/*
+	The sound timer ran out. CHIP-8 and SUPER-CHIP beep now; the XO-CHIP
+	pattern, which played while the timer ran, stops.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::beep()
 {
+	if (muted)
+		return;
 	printf("BEEP!\n");
-	beep_sound.play();
+	if (headless)
+		return;
+	if (Variant::xochip)
+		beep_sound.stop();
+	else
+		beep_sound.play();
+}
+
+/*
+	XO-CHIP: plays the audio pattern at the current pitch while the sound
+	timer runs, after any instruction that changes one of the three.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::update_pattern()
+{
+	if (!Variant::xochip || muted || headless)
+		return;
+	if (sound_timer > 0)
+		beep_sound.play_pattern(pattern, pitch);
+	else
+		beep_sound.stop();
 }
 
 
-hadron8::op_XXXX hadron8::opcodes[16] =
+template <class Variant>
+typename basic_hadron8<Variant>::op_XXXX basic_hadron8<Variant>::handlers[handler_count] =
 {
-	&hadron8::op_0000, &hadron8::op_1NNN, &hadron8::op_2NNN, &hadron8::op_3XNN,
-	&hadron8::op_4XNN, &hadron8::op_5XY0, &hadron8::op_6XNN, &hadron8::op_7XNN,
-	&hadron8::op_8000, &hadron8::op_9XY0, &hadron8::op_ANNN, &hadron8::op_BNNN,
-	&hadron8::op_CXNN, &hadron8::op_DXYN, &hadron8::op_E000, &hadron8::op_F000
+#define HADRON8_HANDLER_PTR(name) &basic_hadron8::op_##name,
+	HADRON8_HANDLERS(HADRON8_HANDLER_PTR)
+#undef HADRON8_HANDLER_PTR
 };
 
-hadron8::op_XXXX hadron8::op_0000_table[16] =
+template <class Variant>
+typename basic_hadron8<Variant>::op_XXXX basic_hadron8<Variant>::opcodes[16] =
 {
-	&hadron8::op_00E0, &hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL,
-	&hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL,
-	&hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL,
-	&hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_00EE, &hadron8::op_NULL
+	&basic_hadron8::nested_0000, &basic_hadron8::template op_1NNN<false>, &basic_hadron8::template op_2NNN<false>, &basic_hadron8::template op_3XNN<false>,
+	&basic_hadron8::template op_4XNN<false>, &basic_hadron8::nested_5000, &basic_hadron8::template op_6XNN<false>, &basic_hadron8::template op_7XNN<false>,
+	&basic_hadron8::nested_8000, &basic_hadron8::nested_9000, &basic_hadron8::template op_ANNN<false>, &basic_hadron8::template op_BNNN<false>,
+	&basic_hadron8::template op_CXNN<false>, &basic_hadron8::template op_DXYN<false>, &basic_hadron8::nested_E000, &basic_hadron8::nested_F000
 };
 
-hadron8::op_XXXX hadron8::op_8000_table[16] =
+template <class Variant>
+typename basic_hadron8<Variant>::op_XXXX basic_hadron8<Variant>::op_0000_table[16] =
 {
-	&hadron8::op_8XY0, &hadron8::op_8XY1, &hadron8::op_8XY2, &hadron8::op_8XY3,
-	&hadron8::op_8XY4, &hadron8::op_8XY5, &hadron8::op_8XY6, &hadron8::op_8XY7,
-	&hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL,
-	&hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_8XYE, &hadron8::op_NULL
+	&basic_hadron8::op_00E0, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid,
+	&basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid,
+	&basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid,
+	&basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_00EE, &basic_hadron8::op_invalid
 };
 
-hadron8::op_XXXX hadron8::op_E000_table[16] =
+template <class Variant>
+typename basic_hadron8<Variant>::op_XXXX basic_hadron8<Variant>::op_8000_table[16] =
 {
-	&hadron8::op_NULL, &hadron8::op_EXA1, &hadron8::op_NULL, &hadron8::op_NULL,
-	&hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL,
-	&hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL,
-	&hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_EX9E, &hadron8::op_NULL
+	&basic_hadron8::template op_8XY0<false>, &basic_hadron8::template op_8XY1<false>, &basic_hadron8::template op_8XY2<false>, &basic_hadron8::template op_8XY3<false>,
+	&basic_hadron8::template op_8XY4<false>, &basic_hadron8::template op_8XY5<false>, &basic_hadron8::template op_8XY6<false>, &basic_hadron8::template op_8XY7<false>,
+	&basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid,
+	&basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::template op_8XYE<false>, &basic_hadron8::op_invalid
 };
 
-hadron8::op_XXXX hadron8::op_F000_table[16] =
+template <class Variant>
+typename basic_hadron8<Variant>::op_XXXX basic_hadron8<Variant>::op_E000_table[16] =
 {
-	&hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_FX33,
-	&hadron8::op_NULL, &hadron8::op_FX05, &hadron8::op_NULL, &hadron8::op_FX07,
-	&hadron8::op_FX18, &hadron8::op_FX29, &hadron8::op_FX0A, &hadron8::op_NULL,
-	&hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_FX1E, &hadron8::op_NULL
+	&basic_hadron8::op_invalid, &basic_hadron8::template op_EXA1<false>, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid,
+	&basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid,
+	&basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid,
+	&basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::template op_EX9E<false>, &basic_hadron8::op_invalid
 };
 
-hadron8::op_XXXX hadron8::op_FX05_table[16] =
+template <class Variant>
+typename basic_hadron8<Variant>::op_XXXX basic_hadron8<Variant>::op_F000_table[16] =
 {
-	&hadron8::op_NULL, &hadron8::op_FX15, &hadron8::op_NULL, &hadron8::op_NULL,
-	&hadron8::op_NULL, &hadron8::op_FX55, &hadron8::op_FX65, &hadron8::op_NULL,
-	&hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL,
-	&hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL, &hadron8::op_NULL
+	&basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::template op_FX33<false>,
+	&basic_hadron8::op_invalid, &basic_hadron8::nested_FX05, &basic_hadron8::op_invalid, &basic_hadron8::template op_FX07<false>,
+	&basic_hadron8::template op_FX18<false>, &basic_hadron8::template op_FX29<false>, &basic_hadron8::template op_FX0A<false>, &basic_hadron8::op_invalid,
+	&basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::template op_FX1E<false>, &basic_hadron8::op_invalid
 };
 
+template <class Variant>
+typename basic_hadron8<Variant>::op_XXXX basic_hadron8<Variant>::op_FX05_table[16] =
+{
+	&basic_hadron8::op_invalid, &basic_hadron8::template op_FX15<false>, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid,
+	&basic_hadron8::op_invalid, &basic_hadron8::template op_FX55<false>, &basic_hadron8::template op_FX65<false>, &basic_hadron8::op_invalid,
+	&basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid,
+	&basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid, &basic_hadron8::op_invalid
+};
+
+/*
+	The nested tables pick a slot by one nibble, which alone does not tell
+	00E0 from 0000 or FX33 from F003. The rest of the opcode has to be that
+	of the instruction in the slot, otherwise it is invalid, as in the
+	decode table.
+*/
+static const uint16_t nested_0000_rest[16] = { 0x0E0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x0EE, 0 };
+static const uint8_t nested_E000_rest[16] = { 0, 0xA1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x9E, 0 };
+static const uint8_t nested_F000_rest[16] = { 0, 0, 0, 0x33, 0, 0, 0, 0x07, 0x18, 0x29, 0x0A, 0, 0, 0, 0x1E, 0 };
+
+template <class Variant>
+void basic_hadron8<Variant>::nested_0000()
+{
+	unsigned slot = opcode & 0x000F;
+	if ((opcode & 0x0FFF) == nested_0000_rest[slot])
+		(this->*op_0000_table[slot])();
+	else
+		op_invalid();
+}
+
+template <class Variant>
+void basic_hadron8<Variant>::nested_E000()
+{
+	unsigned slot = opcode & 0x000F;
+	if ((opcode & 0x00FF) == nested_E000_rest[slot])
+		(this->*op_E000_table[slot])();
+	else
+		op_invalid();
+}
+
+// FX15, FX55 and FX65 share slot 5 and are told apart by nested_FX05
+template <class Variant>
+void basic_hadron8<Variant>::nested_F000()
+{
+	unsigned slot = opcode & 0x000F;
+	if (slot == 5 || (opcode & 0x00FF) == nested_F000_rest[slot])
+		(this->*op_F000_table[slot])();
+	else
+		op_invalid();
+}
+
+/*
+	Any opcode that is not an instruction of the variant. It does nothing;
+	the first one a machine runs into is reported.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_invalid()
+{
+	if (invalid_opcodes++ == 0)
+		fprintf(stderr, "Invalid opcode 0x%04X at 0x%03X\n", opcode, pc);
+}
+
 /*
 	Clears the screen.
 */
-void hadron8::op_00E0()
+template <class Variant>
+void basic_hadron8<Variant>::op_00E0()
 {
 	disp_clear();
 }
@@ -194,29 +496,36 @@ void hadron8::op_00E0()
 /*
 	Returns from a subroutine.
 */
-void hadron8::op_00EE()
+template <class Variant>
+void basic_hadron8<Variant>::op_00EE()
 {
 	--sp;
-	pc = stack[sp];
+	pc = stack_at(sp);
 }
 
 /*
 	Jumps to address NNN.
 */
-void hadron8::op_1NNN()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_1NNN()
 {
-	pc = opcode & 0x0FFF;
+	const DecodedOp d = operands<Table>();
+	pc = d.nnn;
 	inc = 0;
 }
 
 /*
 	Calls subroutine at NNN.
 */
-void hadron8::op_2NNN()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_2NNN()
 {
-	stack[sp] = pc;
+	const DecodedOp d = operands<Table>();
+	stack_at(sp) = pc;
 	++sp;
-	pc = opcode & 0x0FFF;
+	pc = d.nnn;
 	inc = 0;
 }
 
@@ -224,182 +533,241 @@ void hadron8::op_2NNN()
 	Skips the next instruction if VX equals NN. (Usually the next instruction is a jump to skip a code block)
 	if(Vx==NN)
 */
-void hadron8::op_3XNN()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_3XNN()
 {
-	if (V[(opcode & 0x0F00) >> 8] == (opcode & 0x00FF))
-		inc_pc();
+	const DecodedOp d = operands<Table>();
+	if (V[d.x] == d.nn)
+		skip();
 }
 
 /*
 	Skips the next instruction if VX doesn't equal NN. (Usually the next instruction is a jump to skip a code block)
 	if(Vx!=NN)
 */
-void hadron8::op_4XNN()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_4XNN()
 {
-	if (V[(opcode & 0x0F00) >> 8] != (opcode & 0x00FF))
-		inc_pc();
+	const DecodedOp d = operands<Table>();
+	if (V[d.x] != d.nn)
+		skip();
 }
 
 /*
 	Skips the next instruction if VX equals VY. (Usually the next instruction is a jump to skip a code block)
 	if(Vx==Vy)
 */
-void hadron8::op_5XY0()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_5XY0()
 {
-	if (V[(opcode & 0x0F00) >> 8] == V[(opcode & 0x00F0) >> 4])
-		inc_pc();
+	const DecodedOp d = operands<Table>();
+	if (V[d.x] == V[d.y])
+		skip();
 }
 
 /*
 	Sets VX to NN.
 	Vx = NN
 */
-void hadron8::op_6XNN()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_6XNN()
 {
-	V[(opcode & 0x0F00) >> 8] = opcode & 0x00FF;
+	const DecodedOp d = operands<Table>();
+	V[d.x] = d.nn;
 }
 
 /*
 	Adds NN to VX. (Carry flag is not changed)
 	Vx += NN
 */
-void hadron8::op_7XNN()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_7XNN()
 {
-	V[(opcode & 0x0F00) >> 8] += opcode & 0x00FF;
+	const DecodedOp d = operands<Table>();
+	V[d.x] += d.nn;
 }
 
 /*
 	Sets VX to the value of VY.
 	Vx=Vy
 */
-void hadron8::op_8XY0()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_8XY0()
 {
-	V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x00F0) >> 4];
+	const DecodedOp d = operands<Table>();
+	V[d.x] = V[d.y];
 }
 
 /*
 	Sets VX to VX or VY. (Bitwise OR operation)
 	Vx=Vx|Vy
 */
-void hadron8::op_8XY1()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_8XY1()
 {
-	V[(opcode & 0x0F00) >> 8] |= V[(opcode & 0x00F0) >> 4];
+	const DecodedOp d = operands<Table>();
+	V[d.x] |= V[d.y];
 }
 
 /*
 	Sets VX to VX and VY. (Bitwise AND operation)
 	Vx=Vx&Vy
 */
-void hadron8::op_8XY2()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_8XY2()
 {
-	V[(opcode & 0x0F00) >> 8] &= V[(opcode & 0x00F0) >> 4];
+	const DecodedOp d = operands<Table>();
+	V[d.x] &= V[d.y];
 }
 
 /*
 	Sets VX to VX xor VY.
 	Vx=Vx^Vy
 */
-void hadron8::op_8XY3()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_8XY3()
 {
-	V[(opcode & 0x0F00) >> 8] ^= V[(opcode & 0x00F0) >> 4];
+	const DecodedOp d = operands<Table>();
+	V[d.x] ^= V[d.y];
 }
 
 /*
 	Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't.
 	Vx += Vy
 */
-void hadron8::op_8XY4()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_8XY4()
 {
-	if (V[(opcode & 0x00F0) >> 4] > (0xFF - V[(opcode & 0x0F00) >> 8]))
+	const DecodedOp d = operands<Table>();
+	if (V[d.y] > (0xFF - V[d.x]))
 		V[0xF] = 1;
 	else
 		V[0xF] = 0;
-	V[(opcode & 0x0F00) >> 8] += V[(opcode & 0x00F0) >> 4];
+	V[d.x] += V[d.y];
 }
 
 /*
 	VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't.
 	Vx -= Vy
 */
-void hadron8::op_8XY5()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_8XY5()
 {
-	if (V[(opcode & 0x00F0) >> 4] > V[(opcode & 0x0F00) >> 8])
+	const DecodedOp d = operands<Table>();
+	if (V[d.y] > V[d.x])
 		V[0xF] = 0;
 	else
 		V[0xF] = 1;
-	V[(opcode & 0x0F00) >> 8] -= V[(opcode & 0x00F0) >> 4];
+	V[d.x] -= V[d.y];
 }
 
 /*
 	Stores the least significant bit of VX in VF and then shifts VX to the right by 1.
 	Vx>>=1
 */
-void hadron8::op_8XY6()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_8XY6()
 {
-	V[0xF] = V[(opcode & 0x0F00) >> 8] & 0x1;
-	V[(opcode & 0x0F00) >> 8] >>= 1;
+	const DecodedOp d = operands<Table>();
+	V[0xF] = V[d.x] & 0x1;
+	V[d.x] >>= 1;
 }
 
 /*
 	Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't.
 	Vx=Vy-Vx
 */
-void hadron8::op_8XY7()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_8XY7()
 {
-	if (V[(opcode & 0x0F00) >> 8] > V[(opcode & 0x00F0) >> 4])
+	const DecodedOp d = operands<Table>();
+	if (V[d.x] > V[d.y])
 		V[0xF] = 0;
 	else
 		V[0xF] = 1;
-	V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x00F0) >> 4] - V[(opcode & 0x0F00) >> 8];
+	V[d.x] = V[d.y] - V[d.x];
 }
 
 /*
 	Stores the most significant bit of VX in VF and then shifts VX to the left by 1.
 	Vx<<=1
 */
-void hadron8::op_8XYE()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_8XYE()
 {
-	V[0xF] = V[(opcode & 0x0F00) >> 8] >> 7;
-	V[(opcode & 0x0F00) >> 8] <<= 1;
+	const DecodedOp d = operands<Table>();
+	V[0xF] = V[d.x] >> 7;
+	V[d.x] <<= 1;
 }
 
 /*
 	Skips the next instruction if VX doesn't equal VY. (Usually the next instruction is a jump to skip a code block)
 	if(Vx!=Vy)
 */
-void hadron8::op_9XY0()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_9XY0()
 {
-	if (V[(opcode & 0x0F00) >> 8] != V[(opcode & 0x00F0) >> 4])
-		inc_pc();
+	const DecodedOp d = operands<Table>();
+	if (V[d.x] != V[d.y])
+		skip();
 }
 
 /*
 	Sets I to the address NNN.
 	I = NNN
 */
-void hadron8::op_ANNN()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_ANNN()
 {
-	I = opcode & 0x0FFF;
+	const DecodedOp d = operands<Table>();
+	I = d.nnn;
 }
 
 /*
 	Jumps to the address NNN plus V0.
 	PC=V0+NNN
 */
-void hadron8::op_BNNN()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_BNNN()
 {
-	pc = V[0x0] + (opcode & 0x0FFF);
+	const DecodedOp d = operands<Table>();
+	pc = V[0x0] + d.nnn;
 	inc = 0;
 }
 
 /*
 	Sets VX to the result of a bitwise and operation on a random number (Typically: 0 to 255) and NN.
 	Vx=rand()&NN
+
+	The numbers come from a xorshift generator in the machine state rather
+	than rand(), so a fork draws the same ones the original would.
 */
-void hadron8::op_CXNN()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_CXNN()
 {
-	srand(time(NULL));
-	V[(opcode & 0x0F00) >> 8] = (rand() % 0xFF) & (opcode & 0x00FF);
+	const DecodedOp d = operands<Table>();
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	V[d.x] = ((rng >> 8) % 0xFF) & d.nn;
 }
 
 /*
@@ -425,118 +793,194 @@ void hadron8::op_CXNN()
 
 
 */
-void hadron8::op_DXYN()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_DXYN()
 {
-	uint16_t x = V[(opcode & 0x0F00) >> 8];
-	uint16_t y = V[(opcode & 0x00F0) >> 4];
-	uint16_t height = opcode & 0x000F;
-	uint16_t pattern;
+	const DecodedOp d = operands<Table>();
+	uint16_t x = V[d.x];
+	uint16_t y = V[d.y];
+	uint16_t height = d.n;
+	int width = 8;
+	uint16_t address = I;
+
+	// SUPER-CHIP: DXY0 draws a 16x16 sprite, two bytes a row (in both
+	// modes, as Octo does)
+	if (Variant::schip && height == 0)
+	{
+		height = 16;
+		width = 16;
+	}
+
+	// The display is one line of width x height bits: a row that runs off
+	// the right edge continues on the next one, and the bottom wraps to the top
+	const uint16_t screen_bits = screen_width() * screen_height();
 
 	V[0xF] = 0;
-	for (int y_offset = 0; y_offset < height; ++y_offset)
+	// XO-CHIP: each selected plane gets its own sprite, one after another
+	for (int p = 0; p < Variant::planes; ++p)
 	{
-		pattern = memory[I + y_offset];
-		for (int x_offset = 0; x_offset < 8; ++x_offset)
+		if (((selected_planes() >> p) & 1) == 0)
+			continue;
+		for (int y_offset = 0; y_offset < height; ++y_offset)
 		{
-			if ((pattern & (0x80 >> x_offset)) != 0)
-			{
-				if (gfx[(x + x_offset + ((y + y_offset) * 64))] == 1)
-					V[0xF] = 1;
-				gfx[x + x_offset + ((y + y_offset) * 64)] ^= 1;
-			}
+			uint64_t pattern = mem_read(address++);
+			if (Variant::schip && width == 16)
+				pattern = pattern << 8 | mem_read(address++);
+
+			uint16_t bit = (x + (y + y_offset) * screen_width()) & (screen_bits - 1);
+			if (draw_row(gfx[p], bit, pattern, width))
+				V[0xF] = 1;
 		}
 	}
 
+	if (coverage != nullptr)
+		coverage->read(I, (uint16_t)(address - I));
+
 	draw = 1;
 }
 
+/*
+	XORs the width bits of pattern into plane starting at bit, and returns
+	true if that turned any pixel off.
+*/
+template <class Variant>
+bool basic_hadron8<Variant>::draw_row(uint64_t* plane, unsigned bit, uint64_t pattern, int width)
+{
+	const unsigned words = screen_width() * screen_height() / 64;
+	unsigned row = bit >> 6;
+	unsigned shift = bit & 63;
+	unsigned last = 64 - width;
+
+	uint64_t lo, hi;
+	if (shift <= last)
+	{
+		lo = pattern << (last - shift);
+		hi = 0;
+	}
+	else
+	{
+		lo = pattern >> (shift - last);
+		hi = pattern << (64 + last - shift);
+	}
+
+	uint64_t& next = plane[(row + 1) & (words - 1)];
+	bool erased = (plane[row] & lo) != 0 || (next & hi) != 0;
+	plane[row] ^= lo;
+	next ^= hi;
+	return erased;
+}
+
 /*
 	Skips the next instruction if the key stored in VX is pressed. (Usually the next instruction is a jump to skip a code block)
 	if(key()==Vx)
 */
-void hadron8::op_EX9E()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_EX9E()
 {
-	if (key[V[(opcode & 0x0F00) >> 8]] != 0)
-		inc_pc();
+	const DecodedOp d = operands<Table>();
+	if (key_at(V[d.x]) != 0)
+		skip();
 }
 
 /*
 	Skips the next instruction if the key stored in VX isn't pressed. (Usually the next instruction is a jump to skip a code block)
 	if(key()!=Vx)
 */
-void hadron8::op_EXA1()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_EXA1()
 {
-	if (key[V[(opcode & 0x0F00) >> 8]] == 0)
-		inc_pc();
+	const DecodedOp d = operands<Table>();
+	if (key_at(V[d.x]) == 0)
+		skip();
 }
 
 /*
 	Sets VX to the value of the delay timer.
 	Vx = delay_timer
 */
-void hadron8::op_FX07()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_FX07()
 {
-	V[(opcode & 0x0F00) >> 8] = delay_timer;
+	const DecodedOp d = operands<Table>();
+	V[d.x] = delay_timer;
 }
 
 /*
 	A key press is awaited, and then stored in VX. (Blocking Operation. All instruction halted until next key event)
 	Vx = i
+
+	Only a key that goes down after this instruction counts, not one held
+	already. The machine stays on it, and run() stops executing until
+	resume_on_key() sees a new key down.
 */
-void hadron8::op_FX0A()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_FX0A()
 {
-	bool key_press = false;
-	for (int i = 0; i < 16; ++i)
+	const DecodedOp d = operands<Table>();
+	if (key_wait == 0)
 	{
-		if (key[i] != 0)
-		{
-			V[(opcode & 0x0F00) >> 8] = i;
-			key_press = true;
-		}
+		key_wait = 0x10 | d.x;
+		wait_held = get_keys();
 	}
-
-	if (!key_press)
-		return;
+	inc = 0;
 }
 
 /*
 	Sets the delay timer to VX.
 	delay_timer=Vx
 */
-void hadron8::op_FX15()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_FX15()
 {
-	delay_timer = V[(opcode & 0x0F00) >> 8];
+	const DecodedOp d = operands<Table>();
+	delay_timer = V[d.x];
 }
 
 /*
 	Sets the sound timer to VX.
 	sound_timer=Vx
 */
-void hadron8::op_FX18()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_FX18()
 {
-	sound_timer = V[(opcode & 0x0F00) >> 8];
+	const DecodedOp d = operands<Table>();
+	sound_timer = V[d.x];
+	update_pattern();
 }
 
 /*
 	Adds VX to I. VF is set to 1 when there's a carry, and to 0 when there isn't. 
 	I +=Vx
 */
-void hadron8::op_FX1E()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_FX1E()
 {
-	if (I + V[(opcode & 0x0F00) >> 8] > 0xFFF)
+	const DecodedOp d = operands<Table>();
+	if (I + V[d.x] > 0xFFF)
 		V[0xF] = 1;
 	else
 		V[0xF] = 0;
-	I += V[(opcode & 0x0F00) >> 8];
+	I += V[d.x];
 }
 
 /*
 	Sets I to the location of the sprite for the character in VX. Characters 0-F (in hexadecimal) are represented by a 4x5 font.
 	I = Vx * 0x5;
 */
-void hadron8::op_FX29()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_FX29()
 {
-	I = V[(opcode & 0x0F00) >> 8] * 0x5;
+	const DecodedOp d = operands<Table>();
+	I = V[d.x] * 0x5;
 }
 
 /*
@@ -551,11 +995,16 @@ void hadron8::op_FX29()
 	memory[I + 1] = (Vx / 10) % 10;
 	memory[I + 2] = Vx % 10;
 */
-void hadron8::op_FX33()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_FX33()
 {
-	memory[I] = V[(opcode & 0x0F00) >> 8] / 100;
-	memory[I + 1] = (V[(opcode & 0x0F00) >> 8] / 10) % 10;
-	memory[I + 2] = V[(opcode & 0x0F00) >> 8] % 10;
+	const DecodedOp d = operands<Table>();
+	if (coverage != nullptr)
+		coverage->written(I, 3);
+	mem_write(I, V[d.x] / 100);
+	mem_write(I + 1, (V[d.x] / 10) % 10);
+	mem_write(I + 2, V[d.x] % 10);
 }
 
 /*
@@ -563,10 +1012,13 @@ void hadron8::op_FX33()
 	The offset from I is increased by 1 for each value written.
 	reg_dump(x)
 */
-void hadron8::op_FX55()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_FX55()
 {
-	reg_dump((opcode & 0x0F00) >> 8);
-	I += ((opcode & 0x0F00) >> 8) + 1;
+	const DecodedOp d = operands<Table>();
+	reg_dump(d.x);
+	I += d.x + 1;
 }
 
 /*
@@ -574,14 +1026,211 @@ void hadron8::op_FX55()
 	The offset from I is increased by 1 for each value written.
 	reg_load(x)
 */
-void hadron8::op_FX65()
+template <class Variant>
+template <bool Table>
+void basic_hadron8<Variant>::op_FX65()
+{
+	const DecodedOp d = operands<Table>();
+	reg_load(d.x);
+	I += d.x + 1;
+}
+
+/*
+	SUPER-CHIP: scrolls the screen down N pixels.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_00CN()
+{
+	scroll(0, decoded().n);
+}
+
+/*
+	XO-CHIP: scrolls the screen up N pixels.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_00DN()
+{
+	scroll(0, -decoded().n);
+}
+
+/*
+	SUPER-CHIP: scrolls the screen right 4 pixels.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_00FB()
+{
+	scroll(4, 0);
+}
+
+/*
+	SUPER-CHIP: scrolls the screen left 4 pixels.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_00FC()
+{
+	scroll(-4, 0);
+}
+
+/*
+	SUPER-CHIP: exits the interpreter. run() returns right after it.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_00FD()
+{
+	exit_emulation = 1;
+}
+
+/*
+	SUPER-CHIP: switches to the 64x32 mode and clears every plane.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_00FE()
+{
+	hires = false;
+	memset(gfx, 0, sizeof(gfx));
+	draw = 1;
+}
+
+/*
+	SUPER-CHIP: switches to the 128x64 mode and clears every plane.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_00FF()
+{
+	hires = true;
+	memset(gfx, 0, sizeof(gfx));
+	draw = 1;
+}
+
+/*
+	XO-CHIP: stores VX to VY (in either order) in memory starting at I.
+	I does not change.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_5XY2()
+{
+	const DecodedOp& d = decoded();
+	int step = d.x <= d.y ? 1 : -1;
+	int count = (d.x <= d.y ? d.y - d.x : d.x - d.y) + 1;
+	if (coverage != nullptr)
+		coverage->written(I, count);
+	for (int i = 0; i < count; ++i)
+		mem_write(I + i, V[d.x + i * step]);
+}
+
+/*
+	XO-CHIP: loads VX to VY (in either order) from memory starting at I.
+	I does not change.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_5XY3()
+{
+	const DecodedOp& d = decoded();
+	int step = d.x <= d.y ? 1 : -1;
+	int count = (d.x <= d.y ? d.y - d.x : d.x - d.y) + 1;
+	if (coverage != nullptr)
+		coverage->read(I, count);
+	for (int i = 0; i < count; ++i)
+		V[d.x + i * step] = mem_read(I + i);
+}
+
+/*
+	XO-CHIP: sets I to the 16-bit address in the next two bytes, and skips them.
+	I = NNNN
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_F000NNNN()
+{
+	I = mem_read(pc + 2) << 8 | mem_read(pc + 3);
+	inc_pc();
+}
+
+/*
+	XO-CHIP: selects the planes (bit mask N) DXYN, 00E0 and scrolling draw on.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_FN01()
 {
-	reg_load((opcode & 0x0F00) >> 8);
-	I += ((opcode & 0x0F00) >> 8) + 1;
+	plane_mask = decoded().x & 3;
 }
 
-void hadron8::emulate_keyboard()
+/*
+	XO-CHIP: loads the 16 byte audio pattern from memory at I.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_F002()
+{
+	if (coverage != nullptr)
+		coverage->read(I, 16);
+	for (int i = 0; i < 16; ++i)
+		pattern[i] = mem_read(I + i);
+	update_pattern();
+}
+
+/*
+	SUPER-CHIP: sets I to the 8x10 sprite for the digit in VX.
+	I = 0x50 + Vx * 10
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_FX30()
+{
+	const DecodedOp& d = decoded();
+	I = 80 + (V[d.x] & 0xF) * 10;
+}
+
+/*
+	XO-CHIP: sets the audio pattern playback rate to VX.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_FX3A()
 {
+	const DecodedOp& d = decoded();
+	pitch = V[d.x];
+	update_pattern();
+}
+
+/*
+	SUPER-CHIP: stores V0 to VX in the RPL user flags.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_FX75()
+{
+	const DecodedOp& d = decoded();
+	memcpy(rpl, V, d.x + 1);
+}
+
+/*
+	SUPER-CHIP: loads V0 to VX from the RPL user flags.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::op_FX85()
+{
+	const DecodedOp& d = decoded();
+	memcpy(V, rpl, d.x + 1);
+}
+
+template <class Variant>
+void basic_hadron8<Variant>::emulate_keyboard(int frame_cycles)
+{
+	if (headless)
+		return;
+	if (window == nullptr)
+		init_video();
+
+	static const Keymap default_keymap;
+	const Keymap& map = keymap != nullptr ? *keymap : default_keymap;
+
+	// The events below happened since the last poll, during the frame that
+	// was just emulated. The oldest takes effect at the start of the next
+	// frame, as soon as it can, and the others follow it as far apart in
+	// cycles as they were in host time, so key changes keep their spacing
+	// without waiting any longer than applying them all at once would.
+	Uint32 now = SDL_GetTicks();
+	Uint32 span = now - last_poll;
+	Uint32 first = 0;
+	bool any = false;
+	Telemetry::clock::time_point polled = Telemetry::clock::now();
+
 	SDL_Event event;
 	while (SDL_PollEvent(&event)) {
 		switch (event.type) {
@@ -589,130 +1238,162 @@ void hadron8::emulate_keyboard()
 			exit_emulation = 1;
 			break;
 		case SDL_KEYDOWN:
-			switch (event.key.keysym.scancode)
-			{
-			case SDL_SCANCODE_1:
-				key[0x1] = 1;
-				break;
-			case SDL_SCANCODE_2:
-				key[0x2] = 1;
-				break;
-			case SDL_SCANCODE_3:
-				key[0x3] = 1;
-				break;
-			case SDL_SCANCODE_4:
-				key[0xC] = 1;
-				break;
-
-			case SDL_SCANCODE_Q:
-				key[0x4] = 1;
-				break;
-			case SDL_SCANCODE_W:
-				key[0x5] = 1;
-				break;
-			case SDL_SCANCODE_E:
-				key[0x6] = 1;
-				break;
-			case SDL_SCANCODE_R:
-				key[0xD] = 1;
-				break;
-
-			case SDL_SCANCODE_A:
-				key[0x7] = 1;
-				break;
-			case SDL_SCANCODE_S:
-				key[0x8] = 1;
-				break;
-			case SDL_SCANCODE_D:
-				key[0x9] = 1;
-				break;
-			case SDL_SCANCODE_F:
-				key[0xE] = 1;
-				break;
-
-			case SDL_SCANCODE_Z:
-				key[0xA] = 1;
-				break;
-			case SDL_SCANCODE_X:
-				key[0x0] = 1;
-				break;
-			case SDL_SCANCODE_C:
-				key[0xB] = 1;
-				break;
-			case SDL_SCANCODE_V:
-				key[0xF] = 1;
-				break;
-
-			default:
-				puts("Incorrect key pressed");
-			}
-			break;
 		case SDL_KEYUP:
-			switch (event.key.keysym.scancode)
-			{
-			case SDL_SCANCODE_1:
-				key[0x1] = 0;
-				break;
-			case SDL_SCANCODE_2:
-				key[0x2] = 0;
-				break;
-			case SDL_SCANCODE_3:
-				key[0x3] = 0;
-				break;
-			case SDL_SCANCODE_4:
-				key[0xC] = 0;
-				break;
-
-			case SDL_SCANCODE_Q:
-				key[0x4] = 0;
-				break;
-			case SDL_SCANCODE_W:
-				key[0x5] = 0;
-				break;
-			case SDL_SCANCODE_E:
-				key[0x6] = 0;
-				break;
-			case SDL_SCANCODE_R:
-				key[0xD] = 0;
+		{
+			if (event.key.repeat != 0)
 				break;
+			// Latency counts from when SDL saw the key, which may have been
+			// up to a frame before this poll
+			if (telemetry != nullptr)
+			{
+				int32_t age = (int32_t)(now - event.key.timestamp);
+				telemetry->input_event(polled - std::chrono::milliseconds(age > 0 ? age : 0));
+			}
 
-			case SDL_SCANCODE_A:
-				key[0x7] = 0;
-				break;
-			case SDL_SCANCODE_S:
-				key[0x8] = 0;
-				break;
-			case SDL_SCANCODE_D:
-				key[0x9] = 0;
-				break;
-			case SDL_SCANCODE_F:
-				key[0xE] = 0;
+			if (event.key.keysym.scancode == SDL_SCANCODE_F1 && telemetry != nullptr)
+			{
+				if (event.type == SDL_KEYDOWN)
+				{
+					telemetry->toggle_hud();
+					draw = 1;
+				}
 				break;
+			}
 
-			case SDL_SCANCODE_Z:
-				key[0xA] = 0;
-				break;
-			case SDL_SCANCODE_X:
-				key[0x0] = 0;
-				break;
-			case SDL_SCANCODE_C:
-				key[0xB] = 0;
-				break;
-			case SDL_SCANCODE_V:
-				key[0xF] = 0;
+			int k = map.key_for(event.key.keysym.scancode);
+			if (k < 0)
 				break;
-
-			default:
-				puts("Incorrect key released");
+			if (!any)
+			{
+				first = event.key.timestamp;
+				any = true;
 			}
+			int32_t since = (int32_t)(event.key.timestamp - first);
+			uint64_t offset = since <= 0 || span == 0 ? 0 : (uint64_t)since * frame_cycles / span;
+			if (offset >= (uint64_t)frame_cycles)
+				offset = frame_cycles > 0 ? frame_cycles - 1 : 0;
+			queue_key(cycles + offset, k, event.type == SDL_KEYDOWN);
 			break;
+		}
 		default:
 			break;
 		}
 	} // end of message processing
+
+	last_poll = now;
+}
+
+/*
+	Keeps key changes in a ring ordered by cycle; run() makes each one
+	right before the instruction it is due at.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::queue_key(uint64_t at, int k, bool down)
+{
+	InputEvent event = { at, (uint8_t)(k & 0xF), (uint8_t)down };
+	if (input_count == input_queue_size)
+	{
+		apply_input(event);
+		return;
+	}
+	if (input_count > 0)
+	{
+		const InputEvent& last = input_queue[(input_head + input_count - 1) % input_queue_size];
+		if (event.cycle < last.cycle)
+			event.cycle = last.cycle;
+	}
+	input_queue[(input_head + input_count) % input_queue_size] = event;
+	++input_count;
+}
+
+template <class Variant>
+void basic_hadron8<Variant>::flush_input()
+{
+	for (; input_count > 0; --input_count)
+	{
+		apply_input(input_queue[input_head]);
+		input_head = (input_head + 1) % input_queue_size;
+	}
+}
+
+template <class Variant>
+void basic_hadron8<Variant>::apply_input(const InputEvent& event)
+{
+	key[event.key] = event.down;
+	if (input_log != nullptr)
+		fprintf(input_log, "%llu %X %s\n", (unsigned long long)cycles, event.key, event.down ? "down" : "up");
+}
+
+/*
+	Ends an FX0A wait if a key went down since it began: the key goes to VX
+	and execution continues after the FX0A. Keys released meanwhile count
+	again when pressed anew.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::resume_on_key()
+{
+	uint16_t down = get_keys();
+	uint16_t pressed = down & ~wait_held;
+	wait_held &= down;
+	if (pressed == 0)
+		return;
+
+	int k = 0;
+	while (((pressed >> k) & 1) == 0)
+		++k;
+	V[key_wait & 0xF] = (uint8_t)k;
+	key_wait = 0;
+	inc_pc();
+}
+
+/*
+	Lets n cycles pass without executing anything, as if the waiting FX0A
+	had run that many times. The timers keep to their frame ticks.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::idle(uint64_t n)
+{
+	cycles += n;
 }
 
-bool hadron8::load_game(const char* game_file)
+/*
+	The 60 Hz tick of the delay and sound timers, once per frame whatever
+	the instructions per frame. The buzzer sounds when the sound timer runs
+	out.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::tick_timers()
+{
+	if (delay_timer > 0)
+		dec_delay();
+
+	if (sound_timer > 0)
+	{
+		if (sound_timer == 1)
+			beep();
+		dec_sound();
+	}
+}
+
+template <class Variant>
+uint16_t basic_hadron8<Variant>::get_keys() const
+{
+	uint16_t mask = 0;
+	for (int i = 0; i < 16; ++i)
+		if (key[i] != 0)
+			mask |= 1 << i;
+	return mask;
+}
+
+template <class Variant>
+void basic_hadron8<Variant>::set_keys(uint16_t mask)
+{
+	for (int i = 0; i < 16; ++i)
+		key[i] = (mask >> i) & 1;
+}
+
+template <class Variant>
+bool basic_hadron8<Variant>::load_game(const char* game_file)
 {
 	printf("Loading: %s\n", game_file);
 
@@ -728,96 +1409,326 @@ bool hadron8::load_game(const char* game_file)
 	rewind(game);
 	printf("Game size: %d\n", (int)lSize);
 
-	// Allocate memory to contain the whole file
-	int8_t* buffer = (int8_t*)malloc(sizeof(int8_t) * lSize);
-	if (buffer == NULL)
-	{
-		fputs("Memory error", stderr);
-		return false;
-	}
-
 	// Copy the file into the buffer
-	size_t result = fread(buffer, 1, lSize, game);
+	std::vector<uint8_t> buffer(lSize);
+	size_t result = fread(buffer.data(), 1, lSize, game);
+	fclose(game);
 	if (result != lSize)
 	{
 		fputs("Reading error", stderr);
 		return false;
 	}
 
-	// Copy buffer to Chip8 memory
-	if ((4096 - 512) > lSize)
+	return load_program(buffer.data(), buffer.size());
+}
+
+/*
+	Boots the program from memory instead of a file. Returns false, leaving
+	the machine as it was, if the program does not fit.
+*/
+template <class Variant>
+bool basic_hadron8<Variant>::load_program(const uint8_t* program, size_t size)
+{
+	if (size > Variant::memory_size - 512)
 	{
-		for (int i = 0; i < lSize; ++i)
-			memory[i + 512] = buffer[i];
+		printf("Error: ROM too big for memory\n");
+		return false;
 	}
-	else
-		printf("Error: ROM too big for memory");
 
-	// Close file, free buffer
-	fclose(game);
-	free(buffer);
+	// Build the boot image (font sets plus program) and map it into memory
+	std::vector<uint8_t> image = boot_image<Variant>();
+	memcpy(image.data() + 512, program, size);
+
+	std::shared_ptr<Rom> loaded = std::make_shared<Rom>(image.data(), image.size(), size);
 
+	// Decode every instruction the program can be seen to reach once, here,
+	// rather than fetching it again each time it runs. The analysis knows
+	// only CHIP-8 control flow.
+	if (!Variant::schip)
+		loaded->set_code(Analysis(image.data(), loaded->get_program_size()).predecode());
+
+	boot(loaded);
 	return true;
 }
 
-void hadron8::cycle()
+/*
+	Two instructions in one dispatch. Both handlers are known at compile
+	time, so they are inlined here and skip the opcodes[] lookup. The second
+	one only runs if the first fell through to it and memory still holds an
+	instruction of the expected kind there; otherwise only the first one
+	retires and the next dispatch picks up wherever it left pc.
+*/
+template <class Variant>
+template <typename basic_hadron8<Variant>::op_XXXX First, typename basic_hadron8<Variant>::op_XXXX Second, int SecondNibble>
+void basic_hadron8<Variant>::op_fused()
 {
-	opcode = memory[pc] << 8 | memory[pc + 1];
-	
-	(this->*opcodes[(opcode & 0xF000) >> 12])();
+	uint16_t next = pc + 2;
+	(this->*First)();
+	retire();
 
-	if (delay_timer > 0)
-		dec_delay();
+	if (pc != next || exited())
+		return;
+	const PredecodedOp* op = predecoded(pc);
+	opcode = op != nullptr ? op->opcode : mem_read(pc) << 8 | mem_read(pc + 1);
+	if ((opcode >> 12) != SecondNibble)
+		return;
+	(this->*Second)();
+	retire();
+}
 
-	if (sound_timer > 0)
+/*
+	One instruction with its handler inlined, for pairs that are not fused.
+*/
+template <class Variant>
+template <typename basic_hadron8<Variant>::op_XXXX First>
+void basic_hadron8<Variant>::op_single()
+{
+	(this->*First)();
+	retire();
+}
+
+template <class Variant>
+typename basic_hadron8<Variant>::op_XXXX basic_hadron8<Variant>::fused[256];
+
+template <class Variant>
+bool basic_hadron8<Variant>::build_fused()
+{
+#define SINGLE(first, first_name) \
+	for (int second = 0; second < 16; ++second) \
+		fused[(first) << 4 | second] = &basic_hadron8::template op_single<&basic_hadron8::op_##first_name>;
+	SINGLE(0x0, 0000) SINGLE(0x1, 1NNN) SINGLE(0x2, 2NNN) SINGLE(0x3, 3XNN)
+	SINGLE(0x4, 4XNN) SINGLE(0x5, 5000) SINGLE(0x6, 6XNN) SINGLE(0x7, 7XNN)
+	SINGLE(0x8, 8000) SINGLE(0x9, 9000) SINGLE(0xA, ANNN) SINGLE(0xB, BNNN)
+	SINGLE(0xC, CXNN) SINGLE(0xD, DXYN) SINGLE(0xE, E000) SINGLE(0xF, F000)
+#undef SINGLE
+
+#define FUSE(first, first_name, second, second_name) \
+	fused[(first) << 4 | (second)] = &basic_hadron8::template op_fused<&basic_hadron8::op_##first_name, &basic_hadron8::op_##second_name, second>;
+#include "Fusion.inc"
+#undef FUSE
+	return true;
+}
+
+template <class Variant>
+bool basic_hadron8<Variant>::fused_built = basic_hadron8<Variant>::build_fused();
+
+template <class Variant>
+bool basic_hadron8<Variant>::set_native(native_code code, uint64_t rom_hash)
+{
+	if (code != nullptr && rom_hash != rom->get_hash())
 	{
-		if (sound_timer == 1)
-			beep();
-		dec_sound();
+		fprintf(stderr, "Native code was compiled for a different ROM\n");
+		return false;
 	}
+	native = code;
+	return true;
+}
 
-	if (inc == 1)
-		inc_pc();
+/*
+	Runs n instructions, making queued key changes at their cycles. While
+	FX0A waits for a key the cycles pass without executing anything. Stops
+	early once the machine exits (get_exit()).
+*/
+template <class Variant>
+void basic_hadron8<Variant>::run(uint64_t n)
+{
+	uint64_t end = cycles + n;
+	for (;;)
+	{
+		for (; input_count > 0 && input_queue[input_head].cycle <= cycles; --input_count)
+		{
+			apply_input(input_queue[input_head]);
+			input_head = (input_head + 1) % input_queue_size;
+		}
+		if (key_wait != 0)
+			resume_on_key();
+		if (cycles >= end || exit_emulation != 0)
+			return;
+
+		uint64_t until = end;
+		if (input_count > 0 && input_queue[input_head].cycle < end)
+			until = input_queue[input_head].cycle;
+		if (key_wait != 0)
+			idle(until - cycles);
+		else
+			execute(until - cycles);
+	}
+}
+
+/*
+	Runs a frame's worth of instructions and ticks the timers once, which
+	is how the frontend, run-ahead, netplay and the daemon all advance the
+	machine. Nothing else touches the timers, so however a frame is split
+	into run() calls they count down at 60 Hz.
+*/
+template <class Variant>
+void basic_hadron8<Variant>::run_frame(uint64_t n)
+{
+	run(n);
+	if (exit_emulation == 0)
+		tick_timers();
+}
+
+/*
+	Executes n instructions, or up to the one that stops the machine.
+	Unless the instructions are being traced or covered, native code is
+	used if there is any, otherwise fused pairs wherever two or more
+	instructions remain. An FX0A that starts waiting executes again until
+	they are used up, which changes nothing, same as idle().
+*/
+template <class Variant>
+void basic_hadron8<Variant>::execute(uint64_t n)
+{
+	uint64_t end = cycles + n;
+
+	if (native != nullptr && trace == nullptr && coverage == nullptr)
+	{
+		// Native code returns when the budget runs out or at the first
+		// instruction it cannot handle, which the interpreter then steps over
+		while (cycles < end && !exited())
+		{
+			native(*this, end - cycles);
+			if (cycles < end && !exited())
+				cycle();
+		}
+		return;
+	}
+
+	// The pairs are CHIP-8 instructions picked by their top nibbles, which
+	// no longer identify them once the other variants' opcodes exist
+	if (!Variant::schip && fusion && trace == nullptr && coverage == nullptr)
+	{
+		while (end - cycles >= 2 && !exited())
+		{
+			const PredecodedOp* op = predecoded(pc);
+			if (op != nullptr)
+			{
+				opcode = op->opcode;
+				(this->*fused[(opcode >> 8 & 0xF0) | op->next])();
+				continue;
+			}
+			opcode = mem_read(pc) << 8 | mem_read(pc + 1);
+			(this->*fused[(opcode >> 8 & 0xF0) | (mem_read((pc + 2) & (Variant::memory_size - 1)) >> 4)])();
+		}
+	}
+
+	while (cycles < end && !exited())
+		cycle();
+}
+
+template <class Variant>
+void basic_hadron8<Variant>::cycle()
+{
+	uint16_t at = pc;
+	const PredecodedOp* op = predecoded(pc);
+	opcode = op != nullptr ? op->opcode : mem_read(pc) << 8 | mem_read(pc + 1);
+	
+	const DecodedOp& d = decoded();
+
+	if (flat_decode || Variant::schip)
+		(this->*handlers[d.handler])();
 	else
-		inc = 1;
+		(this->*opcodes[(opcode & 0xF000) >> 12])();
+
+	if (trace != nullptr)
+	{
+		uint8_t reg = written_register(d);
+		trace->record(at, opcode, I, reg, reg == trace_no_register ? 0 : V[reg]);
+	}
+	if (coverage != nullptr)
+		coverage->executed(at);
+
+	retire();
 }
 
-void hadron8::draw_gfx()
+/*
+	The register an instruction leaves its result in, for the trace: VX for
+	arithmetic and loads, the last register loaded for 5XY3, VF for the
+	collision flag of DXYN, none for the rest.
+*/
+template <class Variant>
+uint8_t basic_hadron8<Variant>::written_register(const DecodedOp& d) const
 {
-	SDL_UpdateTexture(texture, NULL, pixels, 640 * sizeof(Uint32));
+	switch (d.handler)
+	{
+	case handler_6XNN: case handler_7XNN: case handler_8XY0: case handler_8XY1:
+	case handler_8XY2: case handler_8XY3: case handler_8XY4: case handler_8XY5:
+	case handler_8XY6: case handler_8XY7: case handler_8XYE: case handler_CXNN:
+	case handler_FX07: case handler_FX65: case handler_FX85:
+		return d.x;
+	case handler_5XY3:
+		return d.y;
+	case handler_DXYN:
+		return 0xF;
+	default:
+		return trace_no_register;
+	}
+}
+
+template <class Variant>
+void basic_hadron8<Variant>::draw_gfx()
+{
+	draw_gfx(*this);
+}
+
+template <class Variant>
+void basic_hadron8<Variant>::draw_gfx(const basic_hadron8& frame)
+{
+	if (headless)
+	{
+		draw = 0;
+		return;
+	}
+	if (window == nullptr)
+		init_video();
+
+	// Colours of the plane combinations, plane 0 alone as in CHIP-8
+	static const Uint32 palette[4] = { 0x00, 0xff, 0xff8000, 0xffffff };
+	const int scale = 640 / frame.screen_width();
 
 	//SDL_RenderClear(renderer);
-	for (int x = 0; x < 64; ++x)
+	for (int x = 0; x < frame.screen_width(); ++x)
 	{
-		for (int y = 0; y < 32; ++y)
+		for (int y = 0; y < frame.screen_height(); ++y)
 		{
-			Uint8 col = gfx[x + y * 64] == 0 ? 0x00 : 0xff;
+			int colour = 0;
+			for (int p = 0; p < Variant::planes; ++p)
+				colour |= frame.get_pixel(x, y, p) << p;
+			Uint32 col = palette[colour];
 
-			int _x = x * 10;
-			int _y = y * 10;
+			int _x = x * scale;
+			int _y = y * scale;
 
 
-			for (int x_offset = 0; x_offset < 10; ++x_offset)
+			for (int x_offset = 0; x_offset < scale; ++x_offset)
 			{
-				for (int y_offset = 0; y_offset < 10; ++y_offset)
+				for (int y_offset = 0; y_offset < scale; ++y_offset)
 					pixels[_x + x_offset + ((_y + y_offset) * 640)] = col;
 			}
 		}
 	}
 
+	if (telemetry != nullptr && telemetry->is_hud_visible())
+		telemetry->draw_hud(pixels, 640, 320);
+	SDL_UpdateTexture(texture, NULL, pixels, 640 * sizeof(Uint32));
+
+	Telemetry::clock::time_point present_start = Telemetry::clock::now();
 	SDL_RenderClear(renderer);
 	SDL_RenderCopy(renderer, texture, NULL, NULL);
 	SDL_RenderPresent(renderer);
+	if (telemetry != nullptr)
+		telemetry->presented(present_start, Telemetry::clock::now());
 	draw = 0;
 }
 
-void hadron8::debug_render()
+template <class Variant>
+void basic_hadron8<Variant>::debug_render()
 {
-	for (int y = 0; y < 32; ++y)
+	for (int y = 0; y < screen_height(); ++y)
 	{
-		for (int x = 0; x < 64; ++x)
+		for (int x = 0; x < screen_width(); ++x)
 		{
-			if (gfx[(y * 64) + x] == 0)
+			if (get_pixel(x, y) == 0)
 				printf("O");
 			else
 				printf(" ");
@@ -827,7 +1738,8 @@ void hadron8::debug_render()
 	printf("\n");
 }
 
-void hadron8::debug_keys()
+template <class Variant>
+void basic_hadron8<Variant>::debug_keys()
 {
 	for (int i = 0; i < 16; i++)
 	{
@@ -836,13 +1748,19 @@ void hadron8::debug_keys()
 	}
 }
 
-void hadron8::debug_clock()
+template <class Variant>
+void basic_hadron8<Variant>::debug_clock()
 {
 	printf("Delay Clock is %d\n", delay_timer);
 	printf("Sound Clock is %d\n", sound_timer);
 }
 
-void hadron8::debug_opcode()
+template <class Variant>
+void basic_hadron8<Variant>::debug_opcode()
 {
 	printf("Opcode is 0x%X\n", opcode);
 }
+
+template class basic_hadron8<chip8_variant>;
+template class basic_hadron8<schip_variant>;
+template class basic_hadron8<xochip_variant>;
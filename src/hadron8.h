@@ -5,25 +5,80 @@
 #include <cstdlib>
 #include <cstdint>
 #include <ctime>
+#include <memory>
 
 #include <SDL.h>
 
 #include "Sound.h"
+#include "Memory.h"
+#include "Trace.h"
+#include "Coverage.h"
+#include "Telemetry.h"
+#include "Keymap.h"
+#include "DecodeTable.h"
+#include "Variant.h"
 
 // 0x000 - 0x1FF - Chip 8 interpreter (contains font set in emu)
 // 0x050 - 0x0A0 - Used for the built in 4x5 pixel font set(0 - F)
 // 0x200 - 0xFFF - Program ROM and work RAM
+//
+// SUPER-CHIP and XO-CHIP machines keep their 8x10 font right after the small
+// one, at 0x050 - 0x0EF. XO-CHIP programs run up to 0xFFFF.
 
-class hadron8
+// What happens when a malformed ROM addresses memory beyond its memory size, returns
+// or calls past the 16 stack entries, or tests a key above F:
+//
+//   HADRON8_BOUNDS_UNCHECKED  no masks and no checks. Memory is mirrored
+//                             across the whole 64 KB address space, and the
+//                             stack and keys are padded to 256 entries.
+//                             Stray accesses land in memory the machine
+//                             owns, at the cost of a larger machine to fork.
+//   HADRON8_BOUNDS_WRAP       indices are masked to their range (default)
+//   HADRON8_BOUNDS_TRAP       the access is reported and the machine stops
+//
+// Build with e.g. -DHADRON8_BOUNDS=HADRON8_BOUNDS_TRAP to pick one.
+#define HADRON8_BOUNDS_UNCHECKED 0
+#define HADRON8_BOUNDS_WRAP 1
+#define HADRON8_BOUNDS_TRAP 2
+#ifndef HADRON8_BOUNDS
+#define HADRON8_BOUNDS HADRON8_BOUNDS_WRAP
+#endif
+
+// Code generated by tools/hadron8-aot, one specialisation per ROM hash
+template <uint64_t RomHash> struct hadron8_aot;
+
+// The core, compiled once per variant (see Variant.h). Use the hadron8,
+// schip8 and xochip8 names below.
+template <class Variant>
+class basic_hadron8
 {
+	template <uint64_t RomHash> friend struct hadron8_aot;
 public:
-	hadron8();
-	~hadron8();
+	typedef Variant variant;
+
+	basic_hadron8(bool headless = false);
+	~basic_hadron8();
+
+	basic_hadron8* fork() const;
+	void restore(const basic_hadron8& snapshot);
+	uint64_t state_hash() const;
+
+	static void* operator new(size_t);
+	static void operator delete(void*);
 
 	bool load_game(const char*);
+	bool load_program(const uint8_t* program, size_t size);
 	void cycle();
+	void run(uint64_t);
+	// Runs one 60 Hz frame of n instructions, then ticks the timers
+	void run_frame(uint64_t n);
 	void draw_gfx();
-	void emulate_keyboard();
+	// Presents the screen of another machine (e.g. a run-ahead fork) in this one's window
+	void draw_gfx(const basic_hadron8& frame);
+	// Handles window events. Key changes since the last call are queued to
+	// take effect during the next frame_cycles instructions, the first one
+	// right away and the others spaced from it as they were in host time.
+	void emulate_keyboard(int frame_cycles);
 
 	void debug_render();
 	void debug_keys();
@@ -32,26 +87,114 @@ public:
 
 	inline uint8_t get_draw() const { return draw; }
 	inline uint8_t get_exit() const { return exit_emulation; }
+	inline bool is_headless() const { return headless; }
+	inline uint64_t get_cycles() const { return cycles; }
+	// Size of the screen in the current mode: 64x32, or 128x64 in hires mode
+	inline int screen_width() const { return Variant::schip && hires ? Variant::width : 64; }
+	inline int screen_height() const { return Variant::schip && hires ? Variant::height : 32; }
+	inline uint8_t get_pixel(int x, int y, int plane = 0) const
+	{
+		int bit = y * screen_width() + x;
+		return (gfx[plane][bit >> 6] >> (63 - (bit & 63))) & 1;
+	}
+
+	inline void set_key(int k, uint8_t down) { key[k & 0xF] = down; }
+	// All 16 keys as a bit mask, bit k set while key k is down
+	uint16_t get_keys() const;
+	void set_keys(uint16_t mask);
+	// Presses or releases key k right before instruction number at runs,
+	// or before the next one if the machine is past it. Changes queued out
+	// of order are moved up to the last one; when the queue is full the
+	// change is made at once.
+	void queue_key(uint64_t at, int k, bool down);
+	// Makes every queued key change now
+	void flush_input();
+	// True while FX0A has the machine waiting for a key
+	inline bool is_waiting_for_key() const { return key_wait != 0; }
+	// Host keys for the keypad (nullptr for the default layout)
+	inline void set_keymap(const Keymap* k) { keymap = k; }
+	// Writes every key change made as "cycle key down|up" to f (nullptr to stop)
+	inline void set_input_log(FILE* f) { input_log = f; }
+	// Seeds the random numbers CXNN draws; forks continue the same sequence
+	inline void set_seed(uint32_t seed) { rng = seed != 0 ? seed : 1; }
+	// Silences the beep, forks start muted
+	inline void set_muted(bool m) { muted = m; }
+	inline bool is_muted() const { return muted; }
+
+	// Execute common instruction pairs as one dispatch in run(). The pairs
+	// are CHIP-8 ones, so other variants ignore this.
+	inline void set_fusion(bool f) { fusion = f; }
+	// Dispatch CHIP-8 through the 64K decode table or the original
+	// nibble-indexed tables (default), which decode from the opcode and
+	// stay in L1. Fused pairs and the other variants always use the
+	// decode table.
+	inline void set_flat_decode(bool f) { flat_decode = f; }
+	// Number of undefined opcodes executed so far
+	inline uint64_t get_invalid_opcodes() const { return invalid_opcodes; }
+
+	// Ahead-of-time compiled code for the loaded ROM (see tools/hadron8-aot).
+	// Runs up to budget instructions and returns how many it executed.
+	typedef uint64_t (*native_code)(basic_hadron8&, uint64_t budget);
+	bool set_native(native_code, uint64_t rom_hash);
+	inline const Rom& get_rom() const { return *rom; }
+
+	// Record every executed instruction into the trace (nullptr to stop)
+	inline void set_trace(Trace* t) { trace = t; }
+	// Collect code and data coverage into c (nullptr to stop)
+	inline void set_coverage(Coverage* c) { coverage = c; }
+	// Report key events and presents to t (nullptr to stop); F1 toggles its overlay
+	inline void set_telemetry(Telemetry* t) { telemetry = t; }
 private:
-	const char* beep_filename;
+	static const int page_count = Variant::memory_size >> Page::bits;
+	static const int screen_words = Variant::width * Variant::height / 64;
+#if HADRON8_BOUNDS == HADRON8_BOUNDS_UNCHECKED
+	static const int page_slots = 1 << (16 - Page::bits);
+	static const int stack_slots = 256;
+	static const int key_slots = 256;
+#else
+	static const int page_slots = page_count;
+	static const int stack_slots = 16;
+	static const int key_slots = 16;
+#endif
+
+	bool headless;
 
-	uint16_t stack[16];
-	uint16_t sp;
+	uint16_t stack[stack_slots];
+	uint8_t sp;
 	
 	uint16_t opcode;
-	uint8_t memory[4 * 1024];
+	Page* memory[page_slots]; // Slots past page_count mirror the first ones
+	std::shared_ptr<const Rom> rom;
 	uint16_t I;
 	uint16_t pc;
 	uint8_t V[16];
 	uint8_t exit_emulation;
 	uint8_t inc;
 	uint8_t draw;
-	uint8_t gfx[64 * 32];
+	// One bit per pixel and plane, MSB is the leftmost pixel. The screen is
+	// one line of screen_width() * screen_height() bits, row after row.
+	uint64_t gfx[Variant::planes][screen_words];
+
+	bool hires;         // SUPER-CHIP 128x64 mode
+	uint8_t plane_mask; // XO-CHIP planes DXYN, 00E0 and scrolling work on
+	uint8_t pitch;      // XO-CHIP audio pattern playback rate
+	uint8_t pattern[16];
+	uint8_t rpl[16];    // SUPER-CHIP RPL user flags
 
 	uint8_t delay_timer;
 	uint8_t sound_timer;
 
-	uint8_t key[16];
+	uint64_t cycles;
+	uint64_t invalid_opcodes;
+	uint32_t rng;
+	bool muted;
+	bool fusion;
+	bool flat_decode;
+	native_code native;
+
+	uint8_t key[key_slots];
+	uint8_t key_wait;   // 0x10 | X while FX0A waits for a key to go down
+	uint16_t wait_held; // Keys down since the wait began, which do not count
 
 	SDL_Window* window;
 	SDL_Renderer* renderer;
@@ -59,34 +202,115 @@ private:
 	Uint32* pixels;
 
 	Sound beep_sound;
+	Trace* trace;
+	Coverage* coverage;
+	Telemetry* telemetry;
+
+	// Key changes waiting for their cycle, a ring in cycle order. Forks
+	// start with it empty.
+	struct InputEvent
+	{
+		uint64_t cycle;
+		uint8_t key;
+		uint8_t down;
+	};
+	static const int input_queue_size = 16;
+	InputEvent input_queue[input_queue_size];
+	int input_head;
+	int input_count;
+	uint32_t last_poll; // SDL ticks at the previous emulate_keyboard()
+	const Keymap* keymap;
+	FILE* input_log;
 private:
+	basic_hadron8(const basic_hadron8&);
+	basic_hadron8& operator=(const basic_hadron8&) = delete;
+	void copy_state(const basic_hadron8&);
+
+	void boot(const std::shared_ptr<const Rom>&);
+	void init_video();
 	void disp_clear();
 	void reg_dump(int);
 	void reg_load(int);
 	void beep();
+	void update_pattern();
+	void scroll(int dx, int dy);
+	bool draw_row(uint64_t* plane, unsigned bit, uint64_t pattern, int width);
+	void trap(const char* what, unsigned index);
+	uint8_t written_register(const DecodedOp& d) const;
+	void unshare_page(uint16_t addr);
+	void execute(uint64_t n);
+	void idle(uint64_t n);
+	void tick_timers();
+	void apply_input(const InputEvent& event);
+	void resume_on_key();
+
+	// Operand fields and handler of the current opcode
+	inline const DecodedOp& decoded() const { return decode_table_for<Variant>.ops[opcode]; }
+	// The same fields from the decode table, or taken apart from the opcode
+	// itself so the nested tables run without touching the decode table
+	template <bool Table>
+	inline DecodedOp operands() const
+	{
+		if (Table)
+			return decoded();
+		return DecodedOp{ 0, (uint8_t)(opcode >> 8 & 0xF), (uint8_t)(opcode >> 4 & 0xF), (uint8_t)(opcode & 0xF),
+			(uint8_t)opcode, 1, (uint16_t)(opcode & 0xFFF) };
+	}
+
+	// Groups that need more than the top nibble to find their handler
+	inline void op_0000() { (this->*handlers[decoded().handler])(); }
+	inline void op_5000() { (this->*handlers[decoded().handler])(); }
+	inline void op_8000() { (this->*handlers[decoded().handler])(); }
+	inline void op_9000() { (this->*handlers[decoded().handler])(); }
+	inline void op_E000() { (this->*handlers[decoded().handler])(); }
+	inline void op_F000() { (this->*handlers[decoded().handler])(); }
 
-	inline void op_0000() { (this->*op_0000_table[(opcode & 0x000F) >> 0])(); }
-	inline void op_8000() { (this->*op_8000_table[(opcode & 0x000F) >> 0])(); }
-	inline void op_E000() { (this->*op_E000_table[(opcode & 0x000F) >> 0])(); }
-	inline void op_F000() { (this->*op_F000_table[(opcode & 0x000F) >> 0])(); }
-	inline void op_FX05() { (this->*op_FX05_table[(opcode & 0x00F0) >> 4])(); }
+	// The same groups through the original nested tables
+	void nested_0000();
+	inline void nested_5000() { if ((opcode & 0x000F) == 0) op_5XY0<false>(); else op_invalid(); }
+	inline void nested_8000() { (this->*op_8000_table[(opcode & 0x000F) >> 0])(); }
+	inline void nested_9000() { if ((opcode & 0x000F) == 0) op_9XY0<false>(); else op_invalid(); }
+	void nested_E000();
+	void nested_F000();
+	inline void nested_FX05() { (this->*op_FX05_table[(opcode & 0x00F0) >> 4])(); }
 
 	// OPCODES
 	///////////////////////////////////////////////////////////////
 	inline void op_NULL() {};
+	void op_invalid();
 
-	void op_00E0(); void op_00EE(); void op_1NNN(); void op_2NNN(); 
-	void op_3XNN(); void op_4XNN(); void op_5XY0(); void op_6XNN(); 
-	void op_7XNN(); void op_8XY0(); void op_8XY1(); void op_8XY2();
-	void op_8XY3(); void op_8XY4(); void op_8XY5(); void op_8XY6();
-	void op_8XY7(); void op_8XYE(); void op_9XY0(); void op_ANNN(); 
-	void op_BNNN(); void op_CXNN(); void op_DXYN(); void op_EX9E();
-	void op_EXA1(); void op_FX07(); void op_FX0A(); void op_FX15();
-	void op_FX18(); void op_FX1E(); void op_FX29(); void op_FX33();
-	void op_FX55(); void op_FX65();
+	void op_00E0(); void op_00EE();
+
+	// The rest read their operands from the decode table, or with Table
+	// false take them from the opcode, as the nested tables run them
+	template <bool Table = true> void op_1NNN(); template <bool Table = true> void op_2NNN();
+	template <bool Table = true> void op_3XNN(); template <bool Table = true> void op_4XNN();
+	template <bool Table = true> void op_5XY0(); template <bool Table = true> void op_6XNN();
+	template <bool Table = true> void op_7XNN(); template <bool Table = true> void op_8XY0();
+	template <bool Table = true> void op_8XY1(); template <bool Table = true> void op_8XY2();
+	template <bool Table = true> void op_8XY3(); template <bool Table = true> void op_8XY4();
+	template <bool Table = true> void op_8XY5(); template <bool Table = true> void op_8XY6();
+	template <bool Table = true> void op_8XY7(); template <bool Table = true> void op_8XYE();
+	template <bool Table = true> void op_9XY0(); template <bool Table = true> void op_ANNN();
+	template <bool Table = true> void op_BNNN(); template <bool Table = true> void op_CXNN();
+	template <bool Table = true> void op_DXYN(); template <bool Table = true> void op_EX9E();
+	template <bool Table = true> void op_EXA1(); template <bool Table = true> void op_FX07();
+	template <bool Table = true> void op_FX0A(); template <bool Table = true> void op_FX15();
+	template <bool Table = true> void op_FX18(); template <bool Table = true> void op_FX1E();
+	template <bool Table = true> void op_FX29(); template <bool Table = true> void op_FX33();
+	template <bool Table = true> void op_FX55(); template <bool Table = true> void op_FX65();
+
+	// SUPER-CHIP and XO-CHIP
+	void op_00CN(); void op_00DN(); void op_00FB(); void op_00FC();
+	void op_00FD(); void op_00FE(); void op_00FF(); void op_5XY2();
+	void op_5XY3(); void op_F000NNNN(); void op_FN01(); void op_F002();
+	void op_FX30(); void op_FX3A(); void op_FX75(); void op_FX85();
 	///////////////////////////////////////////////////////////////
 	
-	typedef void (hadron8::*op_XXXX)();
+	typedef void (basic_hadron8::*op_XXXX)();
+
+	// Indexed by DecodedHandler
+	static op_XXXX handlers[handler_count];
 
 	static op_XXXX opcodes[16];
 	static op_XXXX op_0000_table[16];
@@ -95,8 +319,132 @@ private:
 	static op_XXXX op_F000_table[16];
 	static op_XXXX op_FX05_table[16];
 
+	// SUPERINSTRUCTIONS
+	///////////////////////////////////////////////////////////////
+	// Indexed by the top nibbles of two consecutive opcodes. Pairs
+	// listed in Fusion.inc run both instructions, every other entry
+	// runs just the first one.
+	static op_XXXX fused[256];
+	static bool build_fused();
+	static bool fused_built;
+
+	template <op_XXXX First, op_XXXX Second, int SecondNibble>
+	void op_fused();
+	template <op_XXXX First>
+	void op_single();
+	///////////////////////////////////////////////////////////////
+
+
+	// Whether an instruction can stop the machine: SUPER-CHIP's 00FD, or an
+	// out-of-range access under HADRON8_BOUNDS_TRAP. The execution loops only
+	// check for it when one can.
+	static const bool can_exit = Variant::schip || HADRON8_BOUNDS == HADRON8_BOUNDS_TRAP;
+	inline bool exited() const { return can_exit && exit_emulation != 0; }
+
+	// Every access a ROM controls goes through one of these
+	inline Page* page_at(uint16_t addr)
+	{
+#if HADRON8_BOUNDS == HADRON8_BOUNDS_UNCHECKED
+		return memory[addr >> Page::bits];
+#else
+#if HADRON8_BOUNDS == HADRON8_BOUNDS_TRAP
+		if (Variant::memory_size < 65536 && addr >= Variant::memory_size)
+			trap("memory address", addr);
+#endif
+		return memory[(addr >> Page::bits) & (page_count - 1)];
+#endif
+	}
+	inline uint16_t& stack_at(uint8_t index)
+	{
+#if HADRON8_BOUNDS == HADRON8_BOUNDS_UNCHECKED
+		return stack[index];
+#else
+#if HADRON8_BOUNDS == HADRON8_BOUNDS_TRAP
+		if (index >= stack_slots)
+			trap("stack pointer", index);
+#endif
+		return stack[index & (stack_slots - 1)];
+#endif
+	}
+	inline uint8_t key_at(uint8_t index)
+	{
+#if HADRON8_BOUNDS == HADRON8_BOUNDS_UNCHECKED
+		return key[index];
+#else
+#if HADRON8_BOUNDS == HADRON8_BOUNDS_TRAP
+		if (index >= key_slots)
+			trap("key", index);
+#endif
+		return key[index & (key_slots - 1)];
+#endif
+	}
+
+	inline uint8_t mem_read(uint16_t addr)
+	{
+		return page_at(addr)->data[addr & Page::mask];
+	}
+	inline void mem_write(uint16_t addr, uint8_t value)
+	{
+		Page* page = page_at(addr);
+		if (page->refs.load(std::memory_order_relaxed) != 1)
+		{
+			unshare_page(addr);
+			page = page_at(addr);
+		}
+		page->data[addr & Page::mask] = value;
+	}
 	inline void inc_pc() { pc += 2; }
+	// Skips the next instruction, which in XO-CHIP may be the 4 byte F000 NNNN
+	inline void skip()
+	{
+		if (Variant::xochip && mem_read(pc + 2) == 0xF0 && mem_read(pc + 3) == 0x00)
+			inc_pc();
+		inc_pc();
+	}
+	// Planes drawing instructions work on
+	inline int selected_planes() const { return Variant::planes == 1 ? 1 : plane_mask; }
 	inline void dec_delay() { --delay_timer; }
 	inline void dec_sound() { --sound_timer; }
+
+	// Finishes an instruction: moves to the next one
+	inline void retire()
+	{
+		if (inc == 1)
+			inc_pc();
+		else
+			inc = 1;
+
+		++cycles;
+	}
+
+	// The opcode at addr as decoded when the ROM was loaded, or nullptr if
+	// it was not reached by the analysis or its page has been written since
+	inline const PredecodedOp* predecoded(uint16_t addr) const
+	{
+		if (addr >= rom->get_code_size())
+			return nullptr;
+		const PredecodedOp& op = rom->code_at(addr);
+		if (op.valid == 0 || memory[addr >> Page::bits] != rom->page(addr >> Page::bits))
+			return nullptr;
+		return &op;
+	}
+
+	// True if the instruction native code compiled for addr is still there.
+	// Pages nobody wrote to are the ROM's own, so most checks are a compare
+	// of two pointers.
+	inline bool native_code_intact(uint16_t addr, uint16_t op)
+	{
+		if ((addr & Page::mask) != Page::mask && memory[addr >> Page::bits] == rom->page(addr >> Page::bits))
+			return true;
+		return (mem_read(addr) << 8 | mem_read(addr + 1)) == op;
+	}
 };
 
+typedef basic_hadron8<chip8_variant> hadron8;
+typedef basic_hadron8<schip_variant> schip8;
+typedef basic_hadron8<xochip_variant> xochip8;
+
+// Defined in hadron8.cpp
+extern template class basic_hadron8<chip8_variant>;
+extern template class basic_hadron8<schip_variant>;
+extern template class basic_hadron8<xochip_variant>;
@@ -1,24 +1,209 @@
 #include <iostream>
 #include <bitset>
 #include <cmath>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
 
 #include <SDL.h>
 #include <SDL_audio.h>
 
 #include "hadron8.h"
 #include "Sound.h"
+#include "FramePacer.h"
+#include "Trace.h"
+#include "Coverage.h"
+#include "RunAhead.h"
+#include "Netplay.h"
+#include "Telemetry.h"
+#include "Daemon.h"
+#include "Keymap.h"
 
-int main(int argc, char** argv)
+// CHIP-8 instructions executed per 60 Hz frame
+static const int cycles_per_frame = 10;
+
+struct Options
+{
+	const char* game_filename = nullptr;
+	bool headless = false;
+	bool startup_probe = false;
+	long long max_frames = -1;
+	const char* trace_filename = nullptr;
+	const char* coverage_filename = nullptr;
+	const char* native_filename = nullptr;
+	int run_ahead_frames = 0;
+	const char* netplay_address = nullptr;
+	int net_delay = 0;
+	double net_loss = 0.0;
+	const char* stats_filename = nullptr;
+	bool hud = false;
+	const char* daemon_socket = nullptr;
+	int workers = 0;
+	const char* keymap = nullptr;
+	const char* record_filename = nullptr;
+	const char* replay_filename = nullptr;
+};
+
+// A key change from an input recording
+struct RecordedKey
+{
+	uint64_t cycle;
+	int key;
+	bool down;
+};
+
+static void usage()
+{
+	printf("Usage: hadron-chip8.exe [options] [game_filename]\n");
+	printf("       hadron-chip8.exe --daemon SOCKET [--workers N] [--variant V]\n\n");
+	printf("  --headless       run without window, audio or frame pacing\n");
+	printf("  --frames N       stop after N frames\n");
+	printf("  --trace FILE     write a binary execution trace to FILE\n");
+	printf("  --coverage FILE  merge code/data coverage of this run into FILE\n");
+	printf("  --native FILE    run the ROM through a plugin built by hadron8-aot\n");
+	printf("  --variant V      chip8, schip or xochip; by default .sc8 files are\n");
+	printf("                   SUPER-CHIP, .xo8 files XO-CHIP and others CHIP-8\n");
+	printf("  --run-ahead N    show the screen N frames ahead to hide input lag\n");
+	printf("  --netplay LOCAL_PORT:HOST:PORT\n");
+	printf("                   play with a second player over UDP\n");
+	printf("  --net-delay MS   delay every outgoing netplay packet (testing)\n");
+	printf("  --net-loss PCT   drop this share of outgoing packets (testing)\n");
+	printf("  --stats FILE     log frame time, input latency and instructions per\n");
+	printf("                   frame to FILE every 2 seconds\n");
+	printf("  --hud            start with the statistics overlay shown (F1 toggles)\n");
+	printf("  --keymap KEYS    host keys for keypad keys 0 to F, as 16 characters or\n");
+	printf("                   16 SDL key names separated by commas (default %s)\n", Keymap::default_layout);
+	printf("  --record-input FILE\n");
+	printf("                   write the seed and every key change with its cycle\n");
+	printf("  --replay-input FILE\n");
+	printf("                   play back a recording, e.g. with --headless\n");
+	printf("  --daemon SOCKET  serve headless emulation jobs on a Unix socket\n");
+	printf("                   (protocol in src/Daemon.h)\n");
+	printf("  --workers N      cores the daemon runs jobs on, one per CPU by default\n");
+	printf("  --startup-probe  print the steady clock time of the first executed\n");
+	printf("                   instruction in nanoseconds and exit\n\n");
+}
+
+/*
+	Reads a file written with --record-input: a "seed N" line, then one
+	"cycle key down|up" line per key change.
+*/
+static bool load_recording(const char* filename, uint32_t& seed, std::vector<RecordedKey>& keys)
+{
+	FILE* in = fopen(filename, "r");
+	if (in == NULL)
+	{
+		fprintf(stderr, "Cannot open %s\n", filename);
+		return false;
+	}
+
+	bool valid = fscanf(in, "seed %u", &seed) == 1;
+	unsigned long long cycle;
+	unsigned key;
+	char state[8];
+	while (valid && fscanf(in, "%llu %x %7s", &cycle, &key, state) == 3)
+		keys.push_back({ cycle, (int)key, strcmp(state, "down") == 0 });
+	valid = valid && feof(in);
+	fclose(in);
+
+	if (!valid)
+		fprintf(stderr, "%s is not an input recording\n", filename);
+	return valid;
+}
+
+/*
+	Runs the game on the core compiled for Machine's variant.
+*/
+template <class Machine>
+static int play(const Options& options)
 {
-	if (argc < 2)
+	const char* game_filename = options.game_filename;
+	const char* coverage_filename = options.coverage_filename;
+	const char* native_filename = options.native_filename;
+	bool headless = options.headless;
+	int run_ahead_frames = options.run_ahead_frames;
+
+	printf("Variant: %s\n", Machine::variant::name);
+
+	// Plugins and coverage listings only know CHIP-8 instructions
+	if (Machine::variant::schip && (native_filename != nullptr || coverage_filename != nullptr))
 	{
-		printf("Usage: hadron-chip8.exe [game_filename]\n\n");
+		printf("--native and --coverage need a CHIP-8 game\n");
 		return 1;
 	}
 
-	hadron8 h8;
-	if (!h8.load_game(argv[1]))
+	Machine h8(headless);
+	if (!h8.load_game(game_filename))
+		return 1;
+
+	void* native_plugin = nullptr;
+	if (native_filename != nullptr)
+	{
+		native_plugin = SDL_LoadObject(native_filename);
+		if (native_plugin == nullptr)
+		{
+			printf("Cannot load %s: %s\n", native_filename, SDL_GetError());
+			return 1;
+		}
+		const uint64_t* rom_hash = (const uint64_t*)SDL_LoadFunction(native_plugin, "hadron8_aot_rom_hash");
+		typename Machine::native_code code = (typename Machine::native_code)SDL_LoadFunction(native_plugin, "hadron8_aot_run");
+		if (rom_hash == nullptr || code == nullptr || !h8.set_native(code, *rom_hash))
+		{
+			printf("%s is not native code for %s\n", native_filename, game_filename);
+			return 1;
+		}
+	}
+
+	std::unique_ptr<Trace> trace;
+	if (options.trace_filename != nullptr)
+	{
+		trace.reset(new Trace(options.trace_filename));
+		if (!trace->is_open())
+			return 1;
+		h8.set_trace(trace.get());
+	}
+
+	std::unique_ptr<Coverage> coverage;
+	if (coverage_filename != nullptr)
+	{
+		coverage.reset(new Coverage);
+		h8.set_coverage(coverage.get());
+	}
+
+	Telemetry telemetry;
+	if (options.stats_filename != nullptr && !telemetry.open_log(options.stats_filename))
+		return 1;
+	telemetry.set_hud(options.hud);
+	h8.set_telemetry(&telemetry);
+
+	Keymap keymap;
+	if (options.keymap != nullptr && !keymap.parse(options.keymap))
+		return 1;
+	h8.set_keymap(&keymap);
+
+	// Key changes are made at exact cycles, so the seed and the changes
+	// are all it takes to play a session again
+	uint32_t seed = (uint32_t)time(NULL);
+	std::vector<RecordedKey> replay;
+	size_t replayed = 0;
+	if (options.replay_filename != nullptr && !load_recording(options.replay_filename, seed, replay))
 		return 1;
+	h8.set_seed(seed);
+
+	std::unique_ptr<FILE, int (*)(FILE*)> recording(nullptr, fclose);
+	if (options.record_filename != nullptr)
+	{
+		recording.reset(fopen(options.record_filename, "w"));
+		if (!recording)
+		{
+			fprintf(stderr, "Cannot write %s\n", options.record_filename);
+			return 1;
+		}
+		fprintf(recording.get(), "seed %u\n", seed);
+		h8.set_input_log(recording.get());
+	}
 	
 	//if (SDL_Init(SDL_INIT_AUDIO) != 0) SDL_Log("Failed to initialize SDL: %s", SDL_GetError());
 
@@ -26,10 +211,54 @@ int main(int argc, char** argv)
 	//s.load("C:\\dev\\languages\\cpp\\learning\\hadron-chip8\\hadron-chip8\\src\\sound\\beep.wav");
 	//s.play();
 
-	while (h8.get_exit() == 0)
+	if (options.startup_probe)
+	{
+		// Same path a normal run takes up to its first instruction
+		h8.emulate_keyboard(cycles_per_frame);
+		h8.cycle();
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+		printf("first instruction at %lld ns\n", (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+		return 0;
+	}
+
+	std::unique_ptr<Netplay<Machine>> netplay;
+	if (options.netplay_address != nullptr)
+	{
+		unsigned local_port, port;
+		char host[256];
+		if (sscanf(options.netplay_address, "%u:%255[^:]:%u", &local_port, host, &port) != 3)
+		{
+			usage();
+			return 1;
+		}
+		if (run_ahead_frames > 0)
+		{
+			printf("--run-ahead cannot be combined with --netplay\n");
+			return 1;
+		}
+
+		// Both hosts have to draw the same random numbers
+		h8.set_seed((uint32_t)h8.get_rom().get_hash());
+
+		netplay.reset(new Netplay<Machine>(cycles_per_frame));
+		if (!netplay->open(local_port, host, port))
+			return 1;
+		netplay->set_shim(options.net_delay, options.net_loss);
+		printf("Waiting for %s:%u\n", host, port);
+		if (!netplay->wait_for_peer(30000))
+			return 1;
+	}
+
+	FramePacer pacer(60.0);
+	RunAhead<Machine> run_ahead(run_ahead_frames, cycles_per_frame);
+	long long frames = 0;
+
+	while (h8.get_exit() == 0 && frames != options.max_frames)
 	{
+		telemetry.begin_frame();
+
 		/*
-					Emulate hex keyboard
+					Emulate hex keyboard (default --keymap)
 
 			Keypad                   Keyboard
 			+-+-+-+-+                +-+-+-+-+
@@ -42,14 +271,40 @@ int main(int argc, char** argv)
 			|A|0|B|F|                |Z|X|C|V|
 			+-+-+-+-+                +-+-+-+-+
 		*/
-		h8.emulate_keyboard();
+		h8.emulate_keyboard(cycles_per_frame);
+		for (; replayed < replay.size() && replay[replayed].cycle < h8.get_cycles() + cycles_per_frame; ++replayed)
+			h8.queue_key(replay[replayed].cycle, replay[replayed].key, replay[replayed].down);
 
-		// Emulate one cycle
-		h8.cycle();
-	
-		// If the draw flag is set, update the screen
-		if (h8.get_draw() == 1)
-			h8.draw_gfx();
+		if (netplay)
+		{
+			// Netplay exchanges keys once per frame, at its start
+			h8.flush_input();
+
+			// One frame with the other player's keys, rolling back first
+			// if earlier frames guessed them wrong
+			netplay->frame(h8);
+			if (!netplay->is_connected())
+				break;
+
+			if (h8.get_draw() == 1 || telemetry.is_hud_visible())
+				h8.draw_gfx();
+		}
+		else
+		{
+			// Emulate one frame worth of cycles, plus the run-ahead frames if any
+			const Machine& shown = run_ahead.frame(h8);
+		
+			// If the draw flag is set, update the screen; the overlay changes every frame
+			if (shown.get_draw() == 1 || telemetry.is_hud_visible())
+				h8.draw_gfx(shown);
+		}
+
+		// Sleep until the next frame deadline; netplay keeps to it even
+		// headless, both hosts have to advance at the same rate
+		if (!headless || netplay)
+			pacer.wait();
+		telemetry.end_frame(h8.get_cycles());
+		++frames;
 		
 		// Debug functions
 		//h8.debug_render();
@@ -57,6 +312,143 @@ int main(int argc, char** argv)
 		//h8.debug_clock();
 		//h8.debug_opcode();
 	}
+
+	if (!headless)
+		pacer.debug_pacing();
+	if (netplay)
+		netplay->debug_netplay();
+
+	if (coverage)
+	{
+		// Accumulate across runs: fold in whatever the file already holds
+		Coverage previous;
+		bool merged = true;
+		FILE* existing = fopen(coverage_filename, "rb");
+		if (existing != NULL)
+		{
+			fclose(existing);
+			merged = previous.load(coverage_filename);
+			if (merged)
+				coverage->merge(previous);
+		}
+		if (merged)
+			coverage->save(coverage_filename);
+	}
 	
+	if (native_plugin != nullptr)
+		SDL_UnloadObject(native_plugin);
+
+	return 0;
+}
+
+/*
+	Serves emulation jobs for Machine's variant until a client shuts the daemon down.
+*/
+template <class Machine>
+static int serve(const Options& options)
+{
+	int workers = options.workers > 0 ? options.workers : (int)std::thread::hardware_concurrency();
+	Daemon<Machine> daemon(workers > 0 ? workers : 1, cycles_per_frame);
+	if (!daemon.open(options.daemon_socket))
+		return 1;
+	printf("Serving %s jobs on %s\n", Machine::variant::name, options.daemon_socket);
+	fflush(stdout);
+	daemon.serve();
 	return 0;
+}
+
+static bool has_extension(const char* filename, const char* extension)
+{
+	size_t length = strlen(filename), extension_length = strlen(extension);
+	return length >= extension_length && SDL_strcasecmp(filename + length - extension_length, extension) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	const char* variant = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+			options.headless = true;
+		else if (strcmp(argv[i], "--startup-probe") == 0)
+			options.startup_probe = true;
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			options.max_frames = atoll(argv[++i]);
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			options.trace_filename = argv[++i];
+		else if (strcmp(argv[i], "--coverage") == 0 && i + 1 < argc)
+			options.coverage_filename = argv[++i];
+		else if (strcmp(argv[i], "--native") == 0 && i + 1 < argc)
+			options.native_filename = argv[++i];
+		else if (strcmp(argv[i], "--variant") == 0 && i + 1 < argc)
+			variant = argv[++i];
+		else if (strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc)
+			options.run_ahead_frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--netplay") == 0 && i + 1 < argc)
+			options.netplay_address = argv[++i];
+		else if (strcmp(argv[i], "--net-delay") == 0 && i + 1 < argc)
+			options.net_delay = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--net-loss") == 0 && i + 1 < argc)
+			options.net_loss = atof(argv[++i]) / 100.0;
+		else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc)
+			options.stats_filename = argv[++i];
+		else if (strcmp(argv[i], "--hud") == 0)
+			options.hud = true;
+		else if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc)
+			options.daemon_socket = argv[++i];
+		else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+			options.workers = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--keymap") == 0 && i + 1 < argc)
+			options.keymap = argv[++i];
+		else if (strcmp(argv[i], "--record-input") == 0 && i + 1 < argc)
+			options.record_filename = argv[++i];
+		else if (strcmp(argv[i], "--replay-input") == 0 && i + 1 < argc)
+			options.replay_filename = argv[++i];
+		else if (argv[i][0] == '-')
+		{
+			usage();
+			return 1;
+		}
+		else
+			options.game_filename = argv[i];
+	}
+
+	if (options.daemon_socket != nullptr)
+	{
+		if (variant == nullptr || strcmp(variant, "chip8") == 0)
+			return serve<hadron8>(options);
+		if (strcmp(variant, "schip") == 0)
+			return serve<schip8>(options);
+		if (strcmp(variant, "xochip") == 0)
+			return serve<xochip8>(options);
+		usage();
+		return 1;
+	}
+
+	if (options.game_filename == nullptr)
+	{
+		usage();
+		return 1;
+	}
+
+	if (variant == nullptr)
+	{
+		if (has_extension(options.game_filename, ".sc8"))
+			variant = "schip";
+		else if (has_extension(options.game_filename, ".xo8"))
+			variant = "xochip";
+		else
+			variant = "chip8";
+	}
+
+	if (strcmp(variant, "chip8") == 0)
+		return play<hadron8>(options);
+	if (strcmp(variant, "schip") == 0)
+		return play<schip8>(options);
+	if (strcmp(variant, "xochip") == 0)
+		return play<xochip8>(options);
+	usage();
+	return 1;
 }
\ No newline at end of file
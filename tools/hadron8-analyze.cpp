@@ -0,0 +1,78 @@
+// Static ROM analyzer.
+//
+// Disassembles a ROM recursively from 0x200 without running it and prints
+// its control-flow graph: basic blocks grouped by subroutine with their
+// successors, the data the code reads (drawn as bit patterns, so sprites
+// are recognisable), BNNN jumps whose targets had to be guessed and writes
+// that may modify code. --dot writes the graph for Graphviz:
+//
+//   hadron8-analyze --dot pong.dot games/PONG > pong.txt
+//   dot -Tsvg pong.dot -o pong.svg
+//
+// Build it with src/Analysis.cpp, src/Disassembler.cpp and src/Memory.cpp.
+//
+// Usage: hadron8-analyze [--dot FILE] rom
+
+#include <cstdio>
+#include <cstring>
+
+#include "../src/Analysis.h"
+
+static void usage()
+{
+	printf("Usage: hadron8-analyze [--dot FILE] rom\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* dot_filename = nullptr;
+	const char* rom_filename = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--dot") == 0 && i + 1 < argc)
+			dot_filename = argv[++i];
+		else if (argv[i][0] == '-')
+		{
+			usage();
+			return 1;
+		}
+		else
+			rom_filename = argv[i];
+	}
+
+	if (rom_filename == nullptr)
+	{
+		usage();
+		return 1;
+	}
+
+	// Same layout the emulator boots: program at 0x200
+	static uint8_t image[Analysis::size];
+	FILE* rom = fopen(rom_filename, "rb");
+	if (rom == NULL)
+	{
+		fprintf(stderr, "Cannot open %s\n", rom_filename);
+		return 1;
+	}
+	size_t program_size = fread(image + 0x200, 1, Analysis::size - 0x200, rom);
+	fclose(rom);
+
+	Analysis analysis(image, program_size);
+	printf("; %s, %zu bytes\n", rom_filename, program_size);
+	analysis.write_text(stdout);
+
+	if (dot_filename != nullptr)
+	{
+		FILE* dot = fopen(dot_filename, "w");
+		if (dot == NULL)
+		{
+			fprintf(stderr, "Cannot write %s\n", dot_filename);
+			return 1;
+		}
+		const char* name = strrchr(rom_filename, '/');
+		analysis.write_dot(dot, name != nullptr ? name + 1 : rom_filename);
+		fclose(dot);
+	}
+	return 0;
+}
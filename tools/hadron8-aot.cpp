@@ -0,0 +1,256 @@
+// Ahead-of-time ROM recompiler.
+//
+// Disassembles a ROM recursively from 0x200 and writes a C++ translation
+// unit in which every reachable instruction is straight-line code, with
+// direct gotos for jumps, calls and skips. Indirect control flow (BNNN,
+// 00EE) goes through a switch over all compiled addresses. Anything the
+// translation does not cover - unreachable or undefined instructions,
+// targets outside the ROM, code the program has overwritten - is handed
+// back to the interpreter one instruction at a time, so native and
+// interpreted execution leave the machine in the same state.
+//
+// Build the output as a plugin and load it with --native:
+//
+//   hadron8-aot games/PONG pong_aot.cpp
+//   c++ -std=c++17 -O2 -shared -fPIC -Isrc pong_aot.cpp -o pong_aot.so
+//   hadron-chip8 --native ./pong_aot.so games/PONG
+//
+// The emulator must export its symbols to the plugin (-rdynamic on ELF
+// platforms). The generated hadron8_aot<hash>::run can also be linked
+// straight into a program and passed to hadron8::set_native.
+//
+// Usage: hadron8-aot rom output.cpp
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../src/DecodeTable.h"
+#include "../src/Disassembler.h"
+#include "../src/Memory.h"
+
+static const int memory_size = 4096;
+
+static uint8_t image[memory_size];
+static size_t program_end;
+
+static inline uint16_t opcode_at(int addr)
+{
+	return image[addr] << 8 | image[addr + 1];
+}
+
+// Name of the interpreter handler for a defined opcode (op_<name>)
+static const char* handler_name(uint16_t opcode)
+{
+	static const char* names[handler_count] =
+	{
+#define HADRON8_HANDLER_NAME(name) #name,
+		HADRON8_HANDLERS(HADRON8_HANDLER_NAME)
+#undef HADRON8_HANDLER_NAME
+	};
+	return names[decode_table.ops[opcode].handler];
+}
+
+static bool compilable(int addr)
+{
+	return addr >= 0x200 && addr + 1 < (int)program_end && (addr & 1) == 0 && is_valid_opcode(opcode_at(addr));
+}
+
+// Marks every instruction reachable from 0x200 through direct control flow
+static std::vector<bool> find_reachable()
+{
+	std::vector<bool> reachable(memory_size, false);
+	std::vector<int> work(1, 0x200);
+
+	while (!work.empty())
+	{
+		int addr = work.back();
+		work.pop_back();
+		if (addr >= memory_size || reachable[addr] || !compilable(addr))
+			continue;
+		reachable[addr] = true;
+
+		uint16_t op = opcode_at(addr);
+		switch (op & 0xF000)
+		{
+		case 0x0000:
+			if (op != 0x00EE)
+				work.push_back(addr + 2);
+			break;
+		case 0x1000:
+			work.push_back(op & 0x0FFF);
+			break;
+		case 0x2000:
+			work.push_back(op & 0x0FFF);
+			work.push_back(addr + 2);
+			break;
+		case 0x3000: case 0x4000: case 0x5000: case 0x9000: case 0xE000:
+			work.push_back(addr + 2);
+			work.push_back(addr + 4);
+			break;
+		case 0xB000:
+			break;
+		default:
+			work.push_back(addr + 2);
+			break;
+		}
+	}
+	return reachable;
+}
+
+static std::vector<bool> reachable;
+
+// goto for a control transfer to addr, or back to the dispatcher if addr was not compiled
+static void emit_goto(FILE* out, int addr)
+{
+	if (addr < memory_size && reachable[addr])
+		fprintf(out, "goto L_%03X;", addr);
+	else
+		fprintf(out, "goto dispatch;");
+}
+
+// Return to the interpreter if the instruction stopped the machine, which
+// only a trap can do in a CHIP-8 build
+static void emit_exit_check(FILE* out)
+{
+	fprintf(out, "\tif (m.exited()) goto out;\n");
+}
+
+static void emit_instruction(FILE* out, int addr)
+{
+	uint16_t op = opcode_at(addr);
+	unsigned x = (op & 0x0F00) >> 8;
+	unsigned y = (op & 0x00F0) >> 4;
+	unsigned nn = op & 0x00FF;
+	unsigned nnn = op & 0x0FFF;
+	char text[32];
+	disassemble(op, text, sizeof(text));
+
+	fprintf(out, "L_%03X: // %04X  %s\n", addr, op, text);
+	fprintf(out, "\tif (m.cycles == end || !m.native_code_intact(0x%03X, 0x%04X)) goto out;\n", addr, op);
+	fprintf(out, "\tm.opcode = 0x%04X;\n", op);
+
+	switch (op & 0xF000)
+	{
+	case 0x1000:
+		fprintf(out, "\tm.pc = 0x%03X; m.inc = 0; m.retire(); ", nnn);
+		emit_goto(out, nnn);
+		fprintf(out, "\n");
+		return;
+	case 0x2000:
+		fprintf(out, "\tm.op_2NNN(); m.retire();\n");
+		emit_exit_check(out);
+		fprintf(out, "\t");
+		emit_goto(out, nnn);
+		fprintf(out, "\n");
+		return;
+	case 0x3000: case 0x4000: case 0x5000: case 0x9000:
+	{
+		const char* cmp = (op & 0xF000) == 0x3000 || (op & 0xF000) == 0x5000 ? "==" : "!=";
+		if ((op & 0xF000) == 0x3000 || (op & 0xF000) == 0x4000)
+			fprintf(out, "\tif (m.V[0x%X] %s 0x%02X) { m.inc_pc(); m.retire(); ", x, cmp, nn);
+		else
+			fprintf(out, "\tif (m.V[0x%X] %s m.V[0x%X]) { m.inc_pc(); m.retire(); ", x, cmp, y);
+		emit_goto(out, addr + 4);
+		fprintf(out, " }\n\tm.retire(); ");
+		emit_goto(out, addr + 2);
+		fprintf(out, "\n");
+		return;
+	}
+	case 0x6000:
+		fprintf(out, "\tm.V[0x%X] = 0x%02X; m.retire();\n", x, nn);
+		break;
+	case 0x7000:
+		fprintf(out, "\tm.V[0x%X] += 0x%02X; m.retire();\n", x, nn);
+		break;
+	case 0xA000:
+		fprintf(out, "\tm.I = 0x%03X; m.retire();\n", nnn);
+		break;
+	case 0x8000:
+		if ((op & 0x000F) <= 0x3)
+		{
+			static const char* ops[4] = { "=", "|=", "&=", "^=" };
+			fprintf(out, "\tm.V[0x%X] %s m.V[0x%X]; m.retire();\n", x, ops[op & 0x000F], y);
+			break;
+		}
+		// fall through
+	default:
+		fprintf(out, "\tm.op_%s(); m.retire();\n", handler_name(op));
+		emit_exit_check(out);
+		if (op == 0x00EE || (op & 0xF000) == 0xB000)
+		{
+			fprintf(out, "\tgoto dispatch;\n");
+			return;
+		}
+		// Skips and FX0A can leave pc somewhere other than the next instruction
+		fprintf(out, "\tif (m.pc != 0x%03X) goto dispatch;\n", (addr + 2) & 0xFFFF);
+		break;
+	}
+
+	// Straight-line successor
+	if (addr + 2 >= memory_size || !reachable[addr + 2])
+		fprintf(out, "\tgoto dispatch;\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		printf("Usage: hadron8-aot rom output.cpp\n");
+		return 1;
+	}
+
+	FILE* rom = fopen(argv[1], "rb");
+	if (rom == NULL)
+	{
+		fprintf(stderr, "Cannot open %s\n", argv[1]);
+		return 1;
+	}
+	size_t program_size = fread(image + 0x200, 1, memory_size - 0x200, rom);
+	fclose(rom);
+	program_end = 0x200 + program_size;
+
+	uint64_t hash = rom_hash(image + 0x200, program_size);
+	reachable = find_reachable();
+
+	FILE* out = fopen(argv[2], "w");
+	if (out == NULL)
+	{
+		fprintf(stderr, "Cannot write %s\n", argv[2]);
+		return 1;
+	}
+
+	int compiled = 0;
+	for (int addr = 0; addr < memory_size; ++addr)
+		compiled += reachable[addr];
+
+	fprintf(out, "// Generated by tools/hadron8-aot from %s, do not edit.\n", argv[1]);
+	fprintf(out, "// %d instructions compiled.\n\n", compiled);
+	fprintf(out, "#include \"hadron8.h\"\n\n");
+	fprintf(out, "#ifdef _WIN32\n#define HADRON8_AOT_EXPORT __declspec(dllexport)\n#else\n#define HADRON8_AOT_EXPORT\n#endif\n\n");
+	fprintf(out, "template <>\nstruct hadron8_aot<0x%016llXull>\n{\n\tstatic uint64_t run(hadron8& m, uint64_t budget);\n};\n\n",
+		(unsigned long long)hash);
+	fprintf(out, "uint64_t hadron8_aot<0x%016llXull>::run(hadron8& m, uint64_t budget)\n{\n", (unsigned long long)hash);
+	fprintf(out, "\tconst uint64_t start = m.cycles;\n\tconst uint64_t end = start + budget;\n\n");
+
+	fprintf(out, "dispatch:\n\tswitch (m.pc)\n\t{\n");
+	for (int addr = 0; addr < memory_size; ++addr)
+		if (reachable[addr])
+			fprintf(out, "\tcase 0x%03X: goto L_%03X;\n", addr, addr);
+	fprintf(out, "\tdefault: goto out;\n\t}\n\n");
+
+	for (int addr = 0; addr < memory_size; ++addr)
+		if (reachable[addr])
+			emit_instruction(out, addr);
+
+	fprintf(out, "\nout:\n\treturn m.cycles - start;\n}\n\n");
+
+	fprintf(out, "extern \"C\" HADRON8_AOT_EXPORT const uint64_t hadron8_aot_rom_hash = 0x%016llXull;\n\n", (unsigned long long)hash);
+	fprintf(out, "extern \"C\" HADRON8_AOT_EXPORT uint64_t hadron8_aot_run(hadron8& m, uint64_t budget)\n{\n");
+	fprintf(out, "\treturn hadron8_aot<0x%016llXull>::run(m, budget);\n}\n", (unsigned long long)hash);
+	fclose(out);
+
+	printf("%d instructions compiled to %s\n", compiled, argv[2]);
+	return 0;
+}
@@ -0,0 +1,75 @@
+// Merges coverage files written with --coverage and exports them as an
+// annotated disassembly listing and lcov tracefile.
+//
+// Usage: hadron8-cov [--merge OUT.cov] [--lcov OUT.info] rom LISTING.lst run1.cov [run2.cov ...]
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "../src/Coverage.h"
+#include "../src/fontset.h"
+
+static void usage()
+{
+	printf("Usage: hadron8-cov [--merge OUT.cov] [--lcov OUT.info] rom LISTING.lst run1.cov [run2.cov ...]\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* merge_filename = nullptr;
+	const char* lcov_filename = nullptr;
+	std::vector<const char*> positional;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--merge") == 0 && i + 1 < argc)
+			merge_filename = argv[++i];
+		else if (strcmp(argv[i], "--lcov") == 0 && i + 1 < argc)
+			lcov_filename = argv[++i];
+		else if (argv[i][0] == '-')
+		{
+			usage();
+			return 1;
+		}
+		else
+			positional.push_back(argv[i]);
+	}
+
+	if (positional.size() < 3)
+	{
+		usage();
+		return 1;
+	}
+
+	const char* rom_filename = positional[0];
+	const char* listing_filename = positional[1];
+
+	// Same layout the emulator boots: font at 0x000, program at 0x200, so
+	// font rows read by DXYN show their bytes in the listing
+	uint8_t image[Coverage::size] = { 0 };
+	memcpy(image, chip8_fontset, sizeof(chip8_fontset));
+	FILE* rom = fopen(rom_filename, "rb");
+	if (rom == NULL)
+	{
+		fprintf(stderr, "Cannot open %s\n", rom_filename);
+		return 1;
+	}
+	size_t program_size = fread(image + 0x200, 1, Coverage::size - 0x200, rom);
+	fclose(rom);
+
+	std::unique_ptr<Coverage> total(new Coverage);
+	std::unique_ptr<Coverage> run(new Coverage);
+	for (size_t i = 2; i < positional.size(); ++i)
+	{
+		if (!run->load(positional[i]))
+			return 1;
+		total->merge(*run);
+	}
+
+	if (merge_filename != nullptr && !total->save(merge_filename))
+		return 1;
+
+	return total->export_listing(image, program_size, rom_filename, listing_filename, lcov_filename) ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+// Regenerates src/Fusion.inc, the set of instruction pairs the core
+// executes as superinstructions, from execution traces (--trace).
+//
+// Counts how often each pair of top-level opcode groups runs back to back
+// (the second instruction at pc + 2 of the first) over all given traces
+// and keeps the most frequent pairs until they cover the requested share
+// of all executed pairs.
+//
+// Usage: hadron8-fuse [--coverage PERCENT] [--max N] [--out Fusion.inc] trace1.bin [trace2.bin ...]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../src/Trace.h"
+
+// Names of the handlers hadron8::fused[] runs for each top nibble. Groups
+// holding more than one instruction (or undefined opcodes, like 5XY1) go
+// through the decode table.
+static const char* handler_names[16] =
+{
+	"0000", "1NNN", "2NNN", "3XNN", "4XNN", "5000", "6XNN", "7XNN",
+	"8000", "9000", "ANNN", "BNNN", "CXNN", "DXYN", "E000", "F000"
+};
+
+// Groups that always transfer control can never fall through to a second instruction
+static bool can_lead(int nibble)
+{
+	return nibble != 0x1 && nibble != 0x2 && nibble != 0xB;
+}
+
+static void usage()
+{
+	printf("Usage: hadron8-fuse [--coverage PERCENT] [--max N] [--out Fusion.inc] trace1.bin [trace2.bin ...]\n");
+}
+
+static bool count_pairs(const char* filename, unsigned long long* pairs, unsigned long long& total)
+{
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Cannot open %s\n", filename);
+		return false;
+	}
+
+	TraceHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "H8TR", 4) != 0 ||
+		header.record_size != sizeof(TraceRecord))
+	{
+		fprintf(stderr, "%s is not a hadron8 trace\n", filename);
+		fclose(file);
+		return false;
+	}
+
+	TraceRecord records[4096];
+	TraceRecord previous;
+	bool have_previous = false;
+	size_t n;
+
+	while ((n = fread(records, sizeof(TraceRecord), 4096, file)) > 0)
+	{
+		for (size_t i = 0; i < n; ++i)
+		{
+			const TraceRecord& r = records[i];
+			// Records are missing here, so the next one follows no known instruction
+			if (r.reg == trace_gap)
+			{
+				have_previous = false;
+				continue;
+			}
+			if (have_previous)
+			{
+				++total;
+				if (r.pc == ((previous.pc + 2) & 0xFFFF))
+					++pairs[(previous.opcode >> 12) << 4 | (r.opcode >> 12)];
+			}
+			previous = r;
+			have_previous = true;
+		}
+	}
+
+	fclose(file);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	double coverage = 50.0;
+	int max_pairs = 16;
+	const char* out_filename = "Fusion.inc";
+	std::vector<const char*> traces;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--coverage") == 0 && i + 1 < argc)
+			coverage = atof(argv[++i]);
+		else if (strcmp(argv[i], "--max") == 0 && i + 1 < argc)
+			max_pairs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			out_filename = argv[++i];
+		else if (argv[i][0] == '-')
+		{
+			usage();
+			return 1;
+		}
+		else
+			traces.push_back(argv[i]);
+	}
+
+	if (traces.empty())
+	{
+		usage();
+		return 1;
+	}
+
+	unsigned long long pairs[256] = { 0 };
+	unsigned long long total = 0;
+	for (const char* trace : traces)
+		if (!count_pairs(trace, pairs, total))
+			return 1;
+
+	std::vector<int> order;
+	for (int i = 0; i < 256; ++i)
+		if (pairs[i] != 0 && can_lead(i >> 4))
+			order.push_back(i);
+	std::sort(order.begin(), order.end(), [&](int a, int b) { return pairs[a] > pairs[b]; });
+
+	FILE* out = fopen(out_filename, "w");
+	if (out == NULL)
+	{
+		fprintf(stderr, "Cannot write %s\n", out_filename);
+		return 1;
+	}
+
+	fprintf(out, "// Generated by tools/hadron8-fuse from %d trace(s), %llu executed pairs.\n", (int)traces.size(), total);
+	fprintf(out, "// FUSE(first nibble, first handler, second nibble, second handler)\n\n");
+
+	unsigned long long covered = 0;
+	int chosen = 0;
+	for (int pair : order)
+	{
+		if (chosen >= max_pairs || (total != 0 && covered * 100.0 / total >= coverage))
+			break;
+		covered += pairs[pair];
+		++chosen;
+		fprintf(out, "FUSE(0x%X, %s, 0x%X, %s) // %5.2f%%\n", pair >> 4, handler_names[pair >> 4],
+			pair & 0xF, handler_names[pair & 0xF], total == 0 ? 0.0 : pairs[pair] * 100.0 / total);
+	}
+	fclose(out);
+
+	printf("%d pairs covering %.1f%% of executed pairs written to %s\n", chosen,
+		total == 0 ? 0.0 : covered * 100.0 / total, out_filename);
+	return 0;
+}
@@ -0,0 +1,135 @@
+// Offline decoder for binary execution traces written with --trace.
+//
+// Usage: hadron8-trace [options] trace_file
+//   --pc LO-HI        only records whose pc lies in [LO, HI] (hex)
+//   --opcode MASK=VAL only records with (opcode & MASK) == VAL (hex)
+//   --skip N          skip the first N matching records
+//   --count N         print at most N matching records
+//   --summary         print per-instruction execution counts instead
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#include "../src/Trace.h"
+#include "../src/Disassembler.h"
+
+static void usage()
+{
+	printf("Usage: hadron8-trace [--pc LO-HI] [--opcode MASK=VAL] [--skip N] [--count N] [--summary] trace_file\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* filename = nullptr;
+	unsigned pc_lo = 0x000, pc_hi = 0xFFFF;
+	unsigned op_mask = 0x0000, op_value = 0x0000;
+	unsigned long long skip = 0, count = ~0ull;
+	bool summary = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--pc") == 0 && i + 1 < argc)
+			sscanf(argv[++i], "%x-%x", &pc_lo, &pc_hi);
+		else if (strcmp(argv[i], "--opcode") == 0 && i + 1 < argc)
+			sscanf(argv[++i], "%x=%x", &op_mask, &op_value);
+		else if (strcmp(argv[i], "--skip") == 0 && i + 1 < argc)
+			skip = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc)
+			count = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--summary") == 0)
+			summary = true;
+		else if (argv[i][0] == '-')
+		{
+			usage();
+			return 1;
+		}
+		else
+			filename = argv[i];
+	}
+
+	if (filename == nullptr)
+	{
+		usage();
+		return 1;
+	}
+
+	FILE* file = fopen(filename, "rb");
+	if (file == nullptr)
+	{
+		fprintf(stderr, "Cannot open %s\n", filename);
+		return 1;
+	}
+
+	TraceHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "H8TR", 4) != 0 ||
+		header.record_size != sizeof(TraceRecord))
+	{
+		fprintf(stderr, "%s is not a hadron8 trace\n", filename);
+		fclose(file);
+		return 1;
+	}
+
+	// Execution counts and last seen opcode per address for --summary
+	std::vector<unsigned long long> hits(65536, 0);
+	std::vector<uint16_t> last_opcode(65536, 0);
+
+	TraceRecord records[4096];
+	unsigned long long index = 0, matched = 0, printed = 0;
+	size_t n;
+	char text[32];
+
+	while (printed < count && (n = fread(records, sizeof(TraceRecord), 4096, file)) > 0)
+	{
+		for (size_t i = 0; i < n && printed < count; ++i, ++index)
+		{
+			const TraceRecord& r = records[i];
+			if (r.reg == trace_gap)
+			{
+				// Number the records after it as if none had been dropped
+				uint64_t length = trace_gap_length(r);
+				if (!summary && matched >= skip)
+					printf("%10s  ... %llu records dropped ...\n", "", (unsigned long long)length);
+				index += length - 1;
+				continue;
+			}
+			if (r.pc < pc_lo || r.pc > pc_hi || (r.opcode & op_mask) != op_value)
+				continue;
+			if (matched++ < skip)
+				continue;
+
+			if (summary)
+			{
+				++hits[r.pc];
+				last_opcode[r.pc] = r.opcode;
+				continue;
+			}
+
+			disassemble(r.opcode, text, sizeof(text));
+			if (r.reg == trace_no_register)
+				printf("%10llu  %03X  %04X  %-16s I=%03X\n", index, r.pc, r.opcode, text, r.I);
+			else
+				printf("%10llu  %03X  %04X  %-16s I=%03X V%X=%02X\n", index, r.pc, r.opcode, text, r.I, r.reg, r.value);
+			++printed;
+		}
+	}
+	fclose(file);
+
+	if (summary)
+	{
+		std::vector<unsigned> order;
+		for (unsigned pc = 0; pc < 65536; ++pc)
+			if (hits[pc] != 0)
+				order.push_back(pc);
+		std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) { return hits[a] > hits[b]; });
+		for (unsigned pc : order)
+		{
+			disassemble(last_opcode[pc], text, sizeof(text));
+			printf("%03X  %04X  %-16s %12llu\n", pc, last_opcode[pc], text, hits[pc]);
+		}
+	}
+
+	return 0;
+}